@@ -0,0 +1,86 @@
+#ifndef SFXFILE_H
+#define SFXFILE_H
+
+// Reads the binary effect files written by edit_save on the host, the
+// layout is a version byte (0xb3 or older), a row count and the raw SIDFX
+// rows in C64 (little endian) byte order. 0xb5 files have a row count for
+// each of the three voices and then their rows, one voice is read.
+
+#include "../vsid.h"
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+struct SfxFile
+{
+	std::string			name;
+	std::vector<SIDFX>	fx;
+};
+
+// Voice read from 0xb5 files, 0 to 2, the first with rows if -1. Older
+// files are voice 3.
+static int	sfx_voice = -1;
+
+static bool sfx_load(const char * fname, SfxFile & f, std::string & err)
+{
+	FILE	*	file = fopen(fname, "rb");
+	if (!file)
+	{
+		err = "cannot open";
+		return false;
+	}
+
+	unsigned char	head[4];
+	unsigned char	rows[3] = {0, 0, 0};
+	bool			ok = false;
+
+	if (fread(head, 1, 2, file) != 2)
+		err = "file too short";
+	else if (head[0] > 0xb3 && head[0] != 0xb5)
+		err = "incorrect file version";
+	else if (head[0] == 0xb5 && fread(head + 2, 1, 2, file) != 2)
+		err = "file too short";
+	else
+	{
+		if (head[0] == 0xb5)
+			memcpy(rows, head + 1, 3);
+		else
+			rows[2] = head[1];
+
+		int	v = sfx_voice;
+		if (v < 0)
+		{
+			v = 0;
+			while (v < 2 && !rows[v])
+				v++;
+		}
+
+		long	skip = 0;
+		for(int i=0; i<v; i++)
+			skip += rows[i] * sizeof(SIDFX);
+
+		f.name = fname;
+		f.fx.resize(rows[v]);
+		if (fseek(file, skip, SEEK_CUR) || fread(f.fx.data(), sizeof(SIDFX), rows[v], file) != rows[v])
+			err = "file too short";
+		else
+			ok = true;
+	}
+
+	fclose(file);
+	return ok;
+}
+
+// The default effect of a new file in the editor
+static const SIDFX sfx_basefx = {
+	1000, 2048,
+	SID_CTRL_GATE | SID_CTRL_SAW,
+	0x11,
+	0x86,
+	0, 0,
+	4, 0,
+	0
+};
+
+#endif
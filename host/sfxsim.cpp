@@ -0,0 +1,420 @@
+// Headless run of the editor preview model over .sfx files
+//
+//   sfxsim [-csv | -png] [-t ticks] [-pal | -ntsc | -nmi cycles] [-exact] file.sfx...
+//   sfxsim -bench [-t ticks] [-j threads] [-exact] [file.sfx...]
+//   sfxsim -pack file.sfx...
+//
+// Traces are written next to each input as .csv (one line per player tick)
+// or .png (4 pixels per tick like the preview strip). The benchmark replays
+// the given files, or the default effect, on all cores. -exact selects the
+// accurate envelope engine. -pack reports the size of each file as SIDFX
+// rows and as the packed stream of sfxpack.h, checking that it unpacks to
+// the same rows.
+
+#include "sfxfile.h"
+#include "../sfxpack.h"
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <thread>
+
+// Stop single traces after this many ticks, looping effects never get idle
+static const unsigned max_trace_ticks = 10000;
+
+static bool vsid_done(const VirtualSID & v)
+{
+	return v.state == SIDFX_IDLE && v.phase == PHASE_OFF;
+}
+
+static const char * const StateName[5] = {"idle", "reset", "ready", "play", "wait"};
+
+static bool write_csv(const SfxFile & f, const char * oname, unsigned ticks)
+{
+	FILE	*	file = fopen(oname, "w");
+	if (!file)
+		return false;
+
+	VirtualSID	v;
+	vsid_reset(v);
+
+	fprintf(file, "tick,row,state,ctrl,freq,pwm,adsr,level\n");
+	for(unsigned t=0; t<ticks && !vsid_done(v); t++)
+	{
+		vsid_tick(v, f.fx.data(), f.fx.size());
+		for(char i=0; i<VSID_SUBSTEPS; i++)
+			vsid_advance(v);
+
+		fprintf(file, "%u,%u,%s,%u,%u,%u,%u,%u\n",
+			t, v.pos, StateName[v.state], v.ctrl, v.freq, v.pwm, v.adsr, vsid_level(v));
+	}
+
+	fclose(file);
+	return true;
+}
+
+// PNG with stored (uncompressed) deflate blocks, so no zlib is needed
+
+static unsigned crc32_table[256];
+
+static void crc32_init(void)
+{
+	for(unsigned i=0; i<256; i++)
+	{
+		unsigned c = i;
+		for(int k=0; k<8; k++)
+			c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+		crc32_table[i] = c;
+	}
+}
+
+static unsigned crc32_add(unsigned crc, const unsigned char * data, size_t size)
+{
+	for(size_t i=0; i<size; i++)
+		crc = crc32_table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+	return crc;
+}
+
+static void put_be32(std::vector<unsigned char> & b, unsigned v)
+{
+	b.push_back(v >> 24);
+	b.push_back(v >> 16);
+	b.push_back(v >> 8);
+	b.push_back(v);
+}
+
+static void png_chunk(FILE * file, const char * type, const std::vector<unsigned char> & data)
+{
+	std::vector<unsigned char>	b;
+	put_be32(b, data.size());
+	b.insert(b.end(), type, type + 4);
+	b.insert(b.end(), data.begin(), data.end());
+
+	unsigned crc = crc32_add(0xffffffffu, b.data() + 4, b.size() - 4) ^ 0xffffffffu;
+	put_be32(b, crc);
+
+	fwrite(b.data(), 1, b.size(), file);
+}
+
+static bool write_png(const char * oname, const std::vector<unsigned char> & rgb, unsigned w, unsigned h)
+{
+	FILE	*	file = fopen(oname, "wb");
+	if (!file)
+		return false;
+
+	static const unsigned char sig[8] = {0x89, 'P', 'N', 'G', 0x0d, 0x0a, 0x1a, 0x0a};
+	fwrite(sig, 1, 8, file);
+
+	std::vector<unsigned char>	ihdr;
+	put_be32(ihdr, w);
+	put_be32(ihdr, h);
+	ihdr.push_back(8);	// bit depth
+	ihdr.push_back(2);	// truecolour
+	ihdr.push_back(0);
+	ihdr.push_back(0);
+	ihdr.push_back(0);
+	png_chunk(file, "IHDR", ihdr);
+
+	// scanlines with filter byte 0
+	std::vector<unsigned char>	raw;
+	for(unsigned y=0; y<h; y++)
+	{
+		raw.push_back(0);
+		raw.insert(raw.end(), rgb.begin() + y * w * 3, rgb.begin() + (y + 1) * w * 3);
+	}
+
+	std::vector<unsigned char>	z;
+	z.push_back(0x78);
+	z.push_back(0x01);
+
+	size_t	pos = 0;
+	do {
+		size_t		len = raw.size() - pos;
+		if (len > 65535)
+			len = 65535;
+		z.push_back(pos + len == raw.size());
+		z.push_back(len);
+		z.push_back(len >> 8);
+		z.push_back(~len);
+		z.push_back(~len >> 8);
+		z.insert(z.end(), raw.begin() + pos, raw.begin() + pos + len);
+		pos += len;
+	} while (pos < raw.size());
+
+	unsigned	a = 1, b = 0;
+	for(unsigned char c : raw)
+	{
+		a = (a + c) % 65521;
+		b = (b + a) % 65521;
+	}
+	put_be32(z, (b << 16) | a);
+
+	png_chunk(file, "IDAT", z);
+	png_chunk(file, "IEND", std::vector<unsigned char>());
+
+	fclose(file);
+	return true;
+}
+
+static bool trace_png(const SfxFile & f, const char * oname, unsigned ticks)
+{
+	// envelope bar above frequency bar, 64 pixel each, filled below the
+	// curve in the preview colours
+	static const unsigned char EnvColor[3] = {0xee, 0xee, 0x77};
+	static const unsigned char FrqColor[3] = {0x6c, 0x5e, 0xb5};
+
+	std::vector<char>	env, frq;
+
+	VirtualSID	v;
+	vsid_reset(v);
+
+	for(unsigned t=0; t<ticks && !vsid_done(v); t++)
+	{
+		vsid_tick(v, f.fx.data(), f.fx.size());
+		for(char i=0; i<VSID_SUBSTEPS; i++)
+		{
+			vsid_advance(v);
+			env.push_back(vsid_level(v));
+			frq.push_back(v.freq ? (char)(log2(v.freq) * 2) : 0);
+		}
+	}
+
+	unsigned	w = env.size() ? env.size() : 1, h = 129;
+	std::vector<unsigned char>	rgb(w * h * 3);
+
+	for(unsigned x=0; x<env.size(); x++)
+	{
+		for(unsigned y=0; y<64; y++)
+		{
+			if (63 - y <= env[x] * 2)
+				memcpy(&rgb[(y * w + x) * 3], EnvColor, 3);
+			if (63 - y <= frq[x])
+				memcpy(&rgb[((y + 65) * w + x) * 3], FrqColor, 3);
+		}
+	}
+
+	return write_png(oname, rgb, w, h);
+}
+
+// Each thread replays the effect files back to back, restarting at the
+// first file, until it has done its share of ticks
+static void bench_thread(const std::vector<SfxFile> * files, unsigned long ticks, unsigned long * sum)
+{
+	unsigned long	s = 0;
+	size_t			fi = 0;
+	VirtualSID		v;
+
+	vsid_reset(v);
+	for(unsigned long t=0; t<ticks; t++)
+	{
+		const SfxFile & f = (*files)[fi];
+
+		vsid_tick(v, f.fx.data(), f.fx.size());
+		for(char i=0; i<VSID_SUBSTEPS; i++)
+			vsid_advance(v);
+		s += v.adsr + v.freq;
+
+		if (vsid_done(v))
+		{
+			fi = (fi + 1) % files->size();
+			vsid_reset(v);
+		}
+	}
+	*sum = s;
+}
+
+static int bench(std::vector<SfxFile> & files, unsigned long ticks, unsigned threads)
+{
+	if (files.empty())
+	{
+		SfxFile	f;
+		f.name = "default";
+		f.fx.push_back(sfx_basefx);
+		files.push_back(f);
+	}
+
+	std::vector<std::thread>	pool;
+	std::vector<unsigned long>	sums(threads);
+
+	auto	t0 = std::chrono::steady_clock::now();
+	for(unsigned i=0; i<threads; i++)
+		pool.emplace_back(bench_thread, &files, ticks, &sums[i]);
+	for(auto & t : pool)
+		t.join();
+	auto	t1 = std::chrono::steady_clock::now();
+
+	double			secs = std::chrono::duration<double>(t1 - t0).count();
+	unsigned long	check = 0;
+	for(unsigned long s : sums)
+		check += s;
+
+	printf("%u threads, %lu ticks in %.3f s, %.1f Mticks/s (check %08lx)\n",
+		threads, ticks * threads, secs, ticks * threads / secs / 1e6, check & 0xffffffffUL);
+	return 0;
+}
+
+static int pack(const std::vector<SfxFile> & files)
+{
+	unsigned long	rows = 0, packed = 0;
+	int				result = 0;
+
+	for(const SfxFile & f : files)
+	{
+		std::vector<char>	buf(1 + f.fx.size() * SFXP_MAXROW);
+		unsigned			size = sfxpack_encode(buf.data(), f.fx.data(), f.fx.size());
+
+		SIDFX			r;
+		const char	*	sp = buf.data() + 1;
+		bool			same = true;
+
+		std::vector<unsigned>	offs;
+
+		memset(&r, 0, sizeof(SIDFX));
+		for(size_t i=0; i<f.fx.size(); i++)
+		{
+			offs.push_back(sp - buf.data());
+			if (sfxpack_isloop(sp))
+			{
+				// first row, count and the offset of the first row
+				const SIDFX	&	l = f.fx[i];
+				size_t			t = l.freq < i ? l.freq : f.fx.size();
+				if (!vsid_isloop(l) || (unsigned char)sp[2] != t || (unsigned char)sp[3] != l.time1 ||
+					(t < i && sfxpack_word(sp + 4) != offs[t]))
+					same = false;
+				sp += SFXP_LOOPROW;
+			}
+			else
+			{
+				sp = sfxpack_decode(r, sp);
+				if (memcmp(&r, &f.fx[i], sizeof(SIDFX) - 1))
+					same = false;
+			}
+		}
+
+		unsigned	bytes = f.fx.size() * sizeof(SIDFX);
+		printf("%s: %u rows, %u bytes, %u packed (%u%%)%s\n", f.name.c_str(), (unsigned)f.fx.size(),
+			bytes, size, bytes ? size * 100 / bytes : 0, same ? "" : ", DOES NOT UNPACK");
+		if (!same)
+			result = 1;
+
+		rows += bytes;
+		packed += size;
+	}
+
+	if (files.size() > 1)
+		printf("total: %lu bytes, %lu packed (%lu%%)\n", rows, packed, rows ? packed * 100 / rows : 0);
+	return result;
+}
+
+static void usage(void)
+{
+	fprintf(stderr,
+		"usage: sfxsim [-csv | -png] [-t ticks] [-pal | -ntsc | -nmi cycles] [-exact] [-v voice] file.sfx...\n"
+		"       sfxsim -bench [-t ticks] [-j threads] [-exact] [-v voice] [file.sfx...]\n"
+		"       sfxsim -pack [-v voice] file.sfx...\n");
+}
+
+int main(int argc, char ** argv)
+{
+	bool			png = false, bmode = false, pmode = false;
+	unsigned long	ticks = 0;
+	unsigned long	clock = 985248;
+	unsigned		tcycles = 312 * 63;
+	unsigned		threads = std::thread::hardware_concurrency();
+	std::vector<const char *>	names;
+	std::vector<SfxFile>		files;
+
+	if (!threads)
+		threads = 1;
+
+	for(int i=1; i<argc; i++)
+	{
+		if (!strcmp(argv[i], "-csv"))
+			png = false;
+		else if (!strcmp(argv[i], "-png"))
+			png = true;
+		else if (!strcmp(argv[i], "-bench"))
+			bmode = true;
+		else if (!strcmp(argv[i], "-pack"))
+			pmode = true;
+		else if (!strcmp(argv[i], "-t") && i + 1 < argc)
+			ticks = strtoul(argv[++i], nullptr, 0);
+		else if (!strcmp(argv[i], "-pal"))
+		{
+			clock = 985248;
+			tcycles = 312 * 63;
+		}
+		else if (!strcmp(argv[i], "-ntsc"))
+		{
+			clock = 1022727;
+			tcycles = 263 * 65;
+		}
+		else if (!strcmp(argv[i], "-nmi") && i + 1 < argc)
+		{
+			clock = 985248;
+			tcycles = strtoul(argv[++i], nullptr, 0);
+		}
+		else if (!strcmp(argv[i], "-exact"))
+			vsid_accurate = true;
+		else if (!strcmp(argv[i], "-j") && i + 1 < argc)
+			threads = strtoul(argv[++i], nullptr, 0);
+		else if (!strcmp(argv[i], "-v") && i + 1 < argc && argv[i + 1][0] >= '1' && argv[i + 1][0] <= '3')
+			sfx_voice = argv[++i][0] - '1';
+		else if (argv[i][0] == '-')
+		{
+			usage();
+			return 2;
+		}
+		else
+			names.push_back(argv[i]);
+	}
+
+	// options like -v apply to all files wherever they are given
+	for(const char * name : names)
+	{
+		SfxFile		f;
+		std::string	err;
+		if (!sfx_load(name, f, err))
+		{
+			fprintf(stderr, "%s: %s\n", name, err.c_str());
+			return 1;
+		}
+		files.push_back(f);
+	}
+
+	// tick length in 8.8 ms, as the editor computes it
+	vsid_init(tcycles * 2560UL / (clock / 100), tcycles);
+
+	if (bmode)
+		return bench(files, ticks ? ticks : 10000000, threads ? threads : 1);
+
+	if (files.empty())
+	{
+		usage();
+		return 2;
+	}
+
+	if (pmode)
+		return pack(files);
+
+	crc32_init();
+
+	int	result = 0;
+	for(const SfxFile & f : files)
+	{
+		std::string	oname = f.name;
+		size_t		dot = oname.rfind('.');
+		if (dot != std::string::npos && oname.find('/', dot) == std::string::npos)
+			oname.resize(dot);
+		oname += png ? ".png" : ".csv";
+
+		unsigned	n = ticks ? ticks : max_trace_ticks;
+		bool		ok = png ? trace_png(f, oname.c_str(), n) : write_csv(f, oname.c_str(), n);
+		if (!ok)
+		{
+			fprintf(stderr, "%s: cannot write\n", oname.c_str());
+			result = 1;
+		}
+	}
+
+	return result;
+}
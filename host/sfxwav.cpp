@@ -0,0 +1,209 @@
+// Renders .sfx files to 44.1 kHz mono WAV files next to each input
+//
+//   sfxwav [-pal | -ntsc | -nmi cycles] [-s seconds] [-j threads] file.sfx...
+//
+// The effect is stepped with the editor's sidfx state machine once per
+// player tick, 50 Hz PAL, 60 Hz NTSC or every <cycles> PAL cycles for an
+// NMI build, and the register values are fed to a SID voice model. Samples
+// are written in blocks as they are produced, files are spread over all
+// cores.
+
+#include "sfxfile.h"
+#include "sidsynth.h"
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+static const unsigned sample_rate = 44100;
+static const unsigned block_samples = 4096;
+
+struct RenderSetup
+{
+	unsigned	clock;			// cycles per second
+	unsigned	tick_cycles;	// cycles per player tick
+	unsigned	max_seconds;
+};
+
+static void put_le(unsigned char * p, unsigned v, int n)
+{
+	for(int i=0; i<n; i++)
+		p[i] = v >> (8 * i);
+}
+
+static void wav_header(unsigned char * h, unsigned samples)
+{
+	memcpy(h, "RIFF", 4);
+	put_le(h + 4, 36 + 2 * samples, 4);
+	memcpy(h + 8, "WAVEfmt ", 8);
+	put_le(h + 16, 16, 4);
+	put_le(h + 20, 1, 2);					// PCM
+	put_le(h + 22, 1, 2);					// mono
+	put_le(h + 24, sample_rate, 4);
+	put_le(h + 28, sample_rate * 2, 4);
+	put_le(h + 32, 2, 2);
+	put_le(h + 34, 16, 2);
+	memcpy(h + 36, "data", 4);
+	put_le(h + 40, 2 * samples, 4);
+}
+
+static bool render(const SfxFile & f, const char * oname, const RenderSetup & rs)
+{
+	FILE	*	file = fopen(oname, "wb");
+	if (!file)
+		return false;
+
+	unsigned char	header[44];
+	wav_header(header, 0);
+	fwrite(header, 1, 44, file);
+
+	VirtualSID	v;
+	SidVoice	s;
+	vsid_reset(v);
+	sid_reset(s);
+
+	unsigned char	block[2 * block_samples];
+	unsigned		nblock = 0, samples = 0;
+	unsigned		max_samples = rs.max_seconds * sample_rate;
+	unsigned		cfrac = 0, tick_left = 0;
+
+	while (samples < max_samples)
+	{
+		// cycles covered by this sample
+		cfrac += rs.clock;
+		unsigned	cycles = cfrac / sample_rate;
+		cfrac %= sample_rate;
+
+		// player ticks due within this sample are applied before it
+		while (tick_left <= cycles)
+		{
+			vsid_tick(v, f.fx.data(), f.fx.size());
+			// the player drops the gate before a louder sustain and sets
+			// it again in the same tick, which starts a new attack
+			if (v.regate)
+				sid_write(s, s.freq, s.pwm, v.ctrl & ~SID_CTRL_GATE, s.attdec, s.susrel);
+			sid_write(s, v.freq, v.pwm, v.ctrl, v.attdec, v.susrel);
+			tick_left += rs.tick_cycles;
+		}
+		tick_left -= cycles;
+
+		int	smp = sid_sample(s, cycles);
+		block[2 * nblock + 0] = smp;
+		block[2 * nblock + 1] = smp >> 8;
+		nblock++;
+		samples++;
+
+		bool	done = v.state == SIDFX_IDLE && s.env == 0;
+		if (nblock == block_samples || done)
+		{
+			fwrite(block, 2, nblock, file);
+			nblock = 0;
+		}
+		if (done)
+			break;
+	}
+	if (nblock)
+		fwrite(block, 2, nblock, file);
+
+	wav_header(header, samples);
+	fseek(file, 0, SEEK_SET);
+	fwrite(header, 1, 44, file);
+
+	bool	ok = !ferror(file);
+	fclose(file);
+	return ok;
+}
+
+static void usage(void)
+{
+	fprintf(stderr, "usage: sfxwav [-pal | -ntsc | -nmi cycles] [-s seconds] [-j threads] [-v voice] file.sfx...\n");
+}
+
+int main(int argc, char ** argv)
+{
+	RenderSetup		rs = {985248, 312 * 63, 10};
+	unsigned		threads = std::thread::hardware_concurrency();
+	std::vector<const char *>	names;
+
+	for(int i=1; i<argc; i++)
+	{
+		if (!strcmp(argv[i], "-pal"))
+		{
+			rs.clock = 985248;
+			rs.tick_cycles = 312 * 63;
+		}
+		else if (!strcmp(argv[i], "-ntsc"))
+		{
+			rs.clock = 1022727;
+			rs.tick_cycles = 263 * 65;
+		}
+		else if (!strcmp(argv[i], "-nmi") && i + 1 < argc)
+		{
+			rs.clock = 985248;
+			rs.tick_cycles = strtoul(argv[++i], nullptr, 0);
+		}
+		else if (!strcmp(argv[i], "-s") && i + 1 < argc)
+			rs.max_seconds = strtoul(argv[++i], nullptr, 0);
+		else if (!strcmp(argv[i], "-j") && i + 1 < argc)
+			threads = strtoul(argv[++i], nullptr, 0);
+		else if (!strcmp(argv[i], "-v") && i + 1 < argc && argv[i + 1][0] >= '1' && argv[i + 1][0] <= '3')
+			sfx_voice = argv[++i][0] - '1';
+		else if (argv[i][0] == '-')
+		{
+			usage();
+			return 2;
+		}
+		else
+			names.push_back(argv[i]);
+	}
+
+	if (names.empty() || !rs.tick_cycles)
+	{
+		usage();
+		return 2;
+	}
+	if (!threads)
+		threads = 1;
+	if (threads > names.size())
+		threads = names.size();
+
+	std::atomic<size_t>		next(0);
+	std::atomic<int>		result(0);
+	std::mutex				msg;
+
+	auto	worker = [&]()
+	{
+		size_t	i;
+		while ((i = next++) < names.size())
+		{
+			SfxFile		f;
+			std::string	err;
+
+			if (sfx_load(names[i], f, err))
+			{
+				std::string	oname = f.name;
+				size_t		dot = oname.rfind('.');
+				if (dot != std::string::npos && oname.find('/', dot) == std::string::npos)
+					oname.resize(dot);
+				oname += ".wav";
+
+				if (render(f, oname.c_str(), rs))
+					continue;
+				err = "cannot write " + oname;
+			}
+
+			std::lock_guard<std::mutex>	lock(msg);
+			fprintf(stderr, "%s: %s\n", names[i], err.c_str());
+			result = 1;
+		}
+	};
+
+	std::vector<std::thread>	pool;
+	for(unsigned i=0; i<threads; i++)
+		pool.emplace_back(worker);
+	for(auto & t : pool)
+		t.join();
+
+	return result;
+}
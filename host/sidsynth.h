@@ -0,0 +1,176 @@
+#ifndef SIDSYNTH_H
+#define SIDSYNTH_H
+
+// Single SID voice for rendering effects on the host: 24 bit oscillator,
+// triangle, saw, pulse and noise (combined waveforms are ANDed) and the
+// envelope generator with its rate and exponential counters. Sync, ring
+// modulation and the filter are not modelled.
+
+#include "../vsid.h"
+#include <stdint.h>
+
+// Cycles between envelope steps for each rate nibble
+static const unsigned SidRatePeriod[16] = {
+	9, 32, 63, 95, 149, 220, 267, 313, 392, 977, 1954, 3126, 3907, 11720, 19532, 31251
+};
+
+enum SidEnvState
+{
+	SENV_ATTACK,
+	SENV_DECAY,
+	SENV_RELEASE
+};
+
+struct SidVoice
+{
+	uint16_t		freq, pwm;
+	uint8_t			ctrl, attdec, susrel;
+
+	uint32_t		acc, noise;
+	uint8_t			env;
+	SidEnvState		envstate;
+	uint16_t		ratecnt;
+	uint8_t			expcnt;
+};
+
+static void sid_reset(SidVoice & s)
+{
+	s.freq = s.pwm = 0;
+	s.ctrl = s.attdec = s.susrel = 0;
+	s.acc = 0;
+	s.noise = 0x7ffff8;
+	s.env = 0;
+	s.envstate = SENV_RELEASE;
+	s.ratecnt = 0;
+	s.expcnt = 0;
+}
+
+static void sid_write(SidVoice & s, uint16_t freq, uint16_t pwm, uint8_t ctrl, uint8_t attdec, uint8_t susrel)
+{
+	if ((ctrl ^ s.ctrl) & SID_CTRL_GATE)
+		s.envstate = (ctrl & SID_CTRL_GATE) ? SENV_ATTACK : SENV_RELEASE;
+
+	s.freq = freq;
+	s.pwm = pwm & 0x0fff;
+	s.ctrl = ctrl;
+	s.attdec = attdec;
+	s.susrel = susrel;
+}
+
+static unsigned sid_exp_period(uint8_t env)
+{
+	if (env >= 93) return 1;
+	if (env >= 54) return 2;
+	if (env >= 26) return 4;
+	if (env >= 14) return 8;
+	if (env >= 6) return 16;
+	return 30;
+}
+
+// Run the envelope for a number of cycles, the 15 bit rate counter only
+// fires when it hits the period exactly, so a lower period after a rate
+// change lets it run through the full 32768 first like the chip does
+static void sid_envelope(SidVoice & s, unsigned cycles)
+{
+	while (cycles)
+	{
+		unsigned	rate;
+		switch (s.envstate)
+		{
+		case SENV_ATTACK:
+			rate = s.attdec >> 4;
+			break;
+		case SENV_DECAY:
+			rate = s.attdec & 0x0f;
+			break;
+		default:
+			rate = s.susrel & 0x0f;
+			break;
+		}
+
+		unsigned	period = SidRatePeriod[rate];
+		unsigned	togo = s.ratecnt < period ? period - s.ratecnt : 0x8000 - s.ratecnt + period;
+
+		if (cycles < togo)
+		{
+			s.ratecnt = (s.ratecnt + cycles) & 0x7fff;
+			return;
+		}
+
+		cycles -= togo;
+		s.ratecnt = 0;
+
+		if (s.envstate == SENV_ATTACK)
+		{
+			s.expcnt = 0;
+			if (++s.env == 0xff)
+				s.envstate = SENV_DECAY;
+		}
+		else if (++s.expcnt >= sid_exp_period(s.env))
+		{
+			s.expcnt = 0;
+			if (s.envstate == SENV_DECAY)
+			{
+				if (s.env != (s.susrel >> 4) * 0x11)
+					s.env--;
+			}
+			else if (s.env)
+				s.env--;
+		}
+	}
+}
+
+// Clock the oscillator and return the 12 bit waveform output
+static unsigned sid_wave(SidVoice & s, unsigned cycles)
+{
+	if (s.ctrl & SID_CTRL_TEST)
+	{
+		s.acc = 0;
+		s.noise = 0x7ffff8;
+	}
+	else
+	{
+		uint32_t	prev = s.acc;
+		s.acc = (s.acc + s.freq * cycles) & 0xffffff;
+
+		// noise shift register is clocked by bit 19 of the accumulator
+		unsigned	shifts = ((prev & 0x0fffff) + s.freq * cycles) >> 20;
+		while (shifts--)
+		{
+			uint32_t	bit = ((s.noise >> 22) ^ (s.noise >> 17)) & 1;
+			s.noise = ((s.noise << 1) | bit) & 0x7fffff;
+		}
+	}
+
+	unsigned	out = 0xfff;
+	if (s.ctrl & SID_CTRL_TRI)
+	{
+		unsigned	t = s.acc >> 11;
+		out &= ((s.acc & 0x800000) ? t ^ 0x1fff : t) & 0xfff;
+	}
+	if (s.ctrl & SID_CTRL_SAW)
+		out &= s.acc >> 12;
+	if (s.ctrl & SID_CTRL_RECT)
+		out &= (s.acc >> 12) >= s.pwm ? 0xfff : 0x000;
+	if (s.ctrl & SID_CTRL_NOISE)
+	{
+		uint32_t	n = s.noise;
+		out &= ((n >> 11) & 0x800) | ((n >> 10) & 0x400) | ((n >> 7) & 0x200) | ((n >> 5) & 0x100) |
+			   ((n >> 4) & 0x080) | ((n >> 1) & 0x040) | ((n << 1) & 0x020) | ((n << 2) & 0x010);
+	}
+	if (!(s.ctrl & (SID_CTRL_TRI | SID_CTRL_SAW | SID_CTRL_RECT | SID_CTRL_NOISE)))
+		out = 0x800;
+
+	return out;
+}
+
+// One output sample over the given cycles, signed 16 bit at full volume
+static int sid_sample(SidVoice & s, unsigned cycles)
+{
+	unsigned	w = sid_wave(s, cycles);
+	sid_envelope(s, cycles);
+
+	return ((int)w - 0x800) * s.env / 16;
+}
+
+#endif
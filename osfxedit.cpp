@@ -10,6 +10,8 @@
 #include <stdio.h>
 #include <string.h>
 #include <math.h>
+#include "vsid.h"
+#include "sfxpack.h"
 
 static char * const Screen = (char *)0x8000;
 static char * const Sprites = (char *)0x8500;
@@ -19,12 +21,26 @@ static char * const Color = (char *)0xd800;
 
 static const char sprite_img_base = ((Sprites - Screen) / 64);
 
-static const char voice = 2; // can sample envelope on voice 3 if needed for validation
+// voice whose rows are edited, the others keep theirs, ENV3 and OSC3 for
+// the validation are only there for voice 3
+char voice = 2;
 
-static const char max_neffects = 15;
+// effect rows, the last index doubles as the menu position of cursorY
+static const char max_neffects = 255;
 
-#ifdef OSFXEDIT_USE_NMI
-// define this to enable a non-50Hz rate of calling sfx_loop()
+// effect rows on screen, in lines 1 to 15 above the menu
+static const char view_rows = 15;
+
+// last raster line on which the main loop starts another preview column,
+// a column takes a few lines and the isr runs at line 250
+#ifdef OSFXEDIT_SAFETY_LINE
+const char preview_safety_line = OSFXEDIT_SAFETY_LINE;
+#else
+const char preview_safety_line = 230;
+#endif
+
+// the NMI tick gives a non-50Hz rate of calling sfx_loop(), F6 switches
+// to it at runtime, define OSFXEDIT_USE_NMI to start with it
 const char nmi_start_rasterline = 100;
 #ifdef OSFXEDIT_NMI_CYCLES
 const unsigned nmi_cycles = OSFXEDIT_NMI_CYCLES;
@@ -36,22 +52,96 @@ const unsigned nmi_cycles = OSFXEDIT_NMI_CYCLES;
 // adjust as necessary
 const unsigned nmi_cycles = 8189;
 #endif
-#endif
+
+bool		tick_nmi;		// tick from the CIA2 NMI instead of the frame irq
+bool		sys_pal;		// PAL machine, detected at startup
+unsigned	tick_cycles;	// cycles per tick
+
+// CIA2 timer B runs free as a cycle counter, read high byte twice to
+// avoid a torn value when the low byte wraps
+static volatile char * const CycleTimer = (volatile char *)0xdd06;
+
+unsigned cycles_now(void)
+{
+	char	hi, lo;
+	do {
+		hi = CycleTimer[1];
+		lo = CycleTimer[0];
+	} while (hi != CycleTimer[1]);
+
+	return ((unsigned)hi << 8) | lo;
+}
+
+// Profiler, min/avg/max cycles of the main per frame jobs over the last
+// second, shown in place of the menu line
+enum ProfSlot
+{
+	PROF_KEYB,
+	PROF_SFX,
+	PROF_HIRES,
+	PROF_ROW,
+	PROF_MARK,
+	PROF_NUM
+};
+
+struct ProfStat
+{
+	unsigned		min, max;
+	unsigned long	sum;
+	unsigned		cnt;
+};
+
+ProfStat	prof_stats[PROF_NUM];
+char		prof_show;		// shown slot + 1, 0 when off
+char		prof_frames;
+unsigned	prof_bias;		// cost of the measurement itself
+
+void prof_reset(void)
+{
+	for(char i=0; i<PROF_NUM; i++)
+	{
+		prof_stats[i].min = 0xffff;
+		prof_stats[i].max = 0;
+		prof_stats[i].sum = 0;
+		prof_stats[i].cnt = 0;
+	}
+	prof_frames = 0;
+}
+
+inline unsigned prof_begin(void)
+{
+	return prof_show ? cycles_now() : 0;
+}
+
+void prof_add(char slot, unsigned t)
+{
+	ProfStat	&	p = prof_stats[slot];
+	if (t < p.min) p.min = t;
+	if (t > p.max) p.max = t;
+	p.sum += t;
+	p.cnt++;
+}
+
+void prof_end(char slot, unsigned t)
+{
+	if (prof_show)
+		prof_add(slot, t - cycles_now() - prof_bias);
+}
 
 char menubuf[40];
 
 // for use before message displaye, mainly for filename
 void save_menu(void)
 {
-	char* dp = Screen + (max_neffects + 1) * 40;
+	char* dp = Screen + (view_rows + 1) * 40;
 	for (char i = 0; i < 40; i++) menubuf[i] = dp[i];
 }
 
 // for use before message displaye, mainly for filename
 void restore_menu(void)
 {
-	char* dp = Screen + (max_neffects + 1) * 40;
-	char* cp = Color + (max_neffects + 1) * 40;
+	char* dp = Screen + (view_rows + 1) * 40;
+	char* cp = Color + (view_rows + 1) * 40;
 	for (char i = 0; i < 40; i++)
 	{
 		dp[i] = menubuf[i];
@@ -59,11 +149,36 @@ void restore_menu(void)
 	}
 }
 
-char keyb_queue, keyb_repeat;
+// Key events from isr() to the main loop, isr() only moves the head and
+// the main loop only the tail, so no locking is needed
+static const char KEYB_RING_SIZE = 16;
+
+char			keyb_ring[KEYB_RING_SIZE];
+volatile char	keyb_head, keyb_tail;
+char			keyb_repeat;
+
+inline void keyb_push(char k)
+{
+	char h = (keyb_head + 1) & (KEYB_RING_SIZE - 1);
+	if (h != keyb_tail)
+	{
+		keyb_ring[keyb_head] = k;
+		keyb_head = h;
+	}
+}
+
+inline char keyb_pop(void)
+{
+	char k = keyb_ring[keyb_tail];
+	keyb_tail = (keyb_tail + 1) & (KEYB_RING_SIZE - 1);
+	return k;
+}
 char csr_cnt;
-char irq_cnt;
+unsigned irq_cnt;
 char msg_cnt;
 
+void sfx_tick(void);
+
 __interrupt void isr(void)
 {
 	csr_cnt++;
@@ -71,47 +186,46 @@ __interrupt void isr(void)
       msg_cnt--;
       if (msg_cnt == 0) restore_menu();
     }
-#ifndef OSFXEDIT_USE_NMI
-	irq_cnt++;
-	// vic.color_border = VCOL_LT_BLUE;
-	sidfx_loop_2();
-#endif
+	if (!tick_nmi)
+	{
+		irq_cnt++;
+		// vic.color_border = VCOL_LT_BLUE;
+		sfx_tick();
+	}
 
-	// vic.color_border = VCOL_LT_BLUE;
+	unsigned t = prof_begin();
 	keyb_poll();
-	// vic.color_border = VCOL_ORANGE;
+	prof_end(PROF_KEYB, t);
 
-	if (!keyb_queue)
+	if (!(keyb_key & KSCAN_QUAL_DOWN))
 	{
-		if (!(keyb_key & KSCAN_QUAL_DOWN))
+		// only repeat into an empty ring, so a busy main loop does not
+		// pile up cursor moves
+		if (keyb_repeat)
+			keyb_repeat--;
+		else if (keyb_head == keyb_tail)
 		{
-			if (keyb_repeat)
-				keyb_repeat--;
-			else
+			if (key_pressed(KSCAN_CSR_RIGHT))
 			{
-				if (key_pressed(KSCAN_CSR_RIGHT))
-				{
-					if (key_shift())
-						keyb_queue = KSCAN_CSR_RIGHT | KSCAN_QUAL_DOWN | KSCAN_QUAL_SHIFT;
-					else
-						keyb_queue = KSCAN_CSR_RIGHT | KSCAN_QUAL_DOWN;
-					keyb_repeat = 2;
-				}
+				if (key_shift())
+					keyb_push(KSCAN_CSR_RIGHT | KSCAN_QUAL_DOWN | KSCAN_QUAL_SHIFT);
+				else
+					keyb_push(KSCAN_CSR_RIGHT | KSCAN_QUAL_DOWN);
+				keyb_repeat = 2;
 			}
 		}
-		else
-		{
-			keyb_queue = keyb_key;
-			keyb_repeat = 20;
-		}
+	}
+	else
+	{
+		keyb_push(keyb_key);
+		keyb_repeat = 20;
 	}
 	// vic.color_border = VCOL_BLACK;
 }
 
-#ifdef OSFXEDIT_USE_NMI
 __interrupt void nmi_isr(void) {
   irq_cnt++;
-  sidfx_loop_2();
+  sfx_tick();
 }
 
 void nmi_isr_stub(void) {
@@ -143,9 +257,8 @@ go_isr:
   }
 }
 
-#endif
 
-RIRQCode	rirq_isr, rirq_mark0, rirq_mark1, rirq_bitmap;
+RIRQCode	rirq_isr, rirq_mark0, rirq_mark1, rirq_env, rirq_frq;
 
 const SIDFX basefx = {
 	1000, 2048, 
@@ -157,436 +270,3473 @@ const SIDFX basefx = {
 	0
 };
 
-SIDFX	effects[max_neffects];
+// 255 rows do not fit below the screen, they live in the RAM at 0xc000.
+// The three voices share them, the voice being edited always comes last
+// so its rows grow and shrink without moving those of the others.
+static SIDFX * const FxPool = (SIDFX *)0xc000;
+
+// Effect files start with the version, 0xb5 files hold the row counts of
+// the three voices and their rows, older ones the rows of voice 3 only
+static const char file_version = 0xb5;
 
+// The packed streams of the voices for the player cost and the packed
+// export, a row count each and at most SFXP_MAXROW bytes per row. It is a
+// declared array, so the linker keeps it clear of the code and of the
+// software stack at the top of the main region; 0xc000 has only about
+// 500 bytes left after FxPool.
+static const unsigned pack_max = 3 + max_neffects * SFXP_MAXROW;
+
+char	PackBuf[pack_max];
+
+SIDFX *	effects = FxPool;
 char	neffects = 1;
 
-const char SidHead[] = S"  TSRNG FREQ  PWM  ADSR DFREQ DPWM T1 T0";
-const char SidRow[]  = S"# TSRNG 00000 0000 0000 00000 0000 00 00";
-const char MenuRow[] = S"LOAD SAVE NEW  D09  [..............]    ";
+// first row and rows of each voice, the rows of the edited voice are
+// neffects
+SIDFX *	voice_fx[3] = {FxPool, FxPool, FxPool};
+char	voice_rows[3];
 
-const char HexDigit[] = S"0123456789ABCDEF";
+inline char voice_nrows(char ch)
+{
+	return ch == voice ? neffects : voice_rows[ch];
+}
 
+// Rows of all voices
+inline char fx_total(void)
+{
+	return (effects - FxPool) + neffects;
+}
 
-void uto5digit(unsigned u, char * d)
+// Rows the edited voice can have
+inline char fx_room(void)
 {
-	for(signed char i=4; i>=0; i--)
+	return max_neffects - (effects - FxPool);
+}
+
+// first effect row shown on screen
+char	view_top;
+
+// sidfx has no loop rows, voices with loops are played by sfxpack from
+// PackBuf. A loop that cannot be played is reported by the main loop.
+char	fx_bad, fx_bad_voice;
+bool	fx_bad_done;
+
+bool fx_has_loop(const SIDFX * fx, char n)
+{
+	for(char i=0; i<n; i++)
 	{
-		d[i] = u % 10 + 48;
-		u /= 10;
+		if (vsid_isloop(fx[i]))
+			return true;
 	}
+	return false;
 }
 
-char cursorX, cursorY;
-char drive = 9; // vice defaults to an iecdrive9 on host file system, which is a convenient use case
-
-void showdrive(void)
+bool fx_any_loop(void)
 {
-	char* dp = Screen + (max_neffects + 1) * 40;
-	char* cp = Color + (max_neffects + 1) * 40;
-    
-    char fs[6];
-	uto5digit(drive, fs);
-	for (char i = 0; i < 2; i++)
+	for(char ch=0; ch<3; ch++)
 	{
-		dp[16 + i] = fs[i + 3];
-		cp[16 + i] = VCOL_LT_BLUE;
+		if (fx_has_loop(voice_fx[ch], voice_nrows(ch)))
+			return true;
 	}
+	return false;
 }
 
-void showmenu(void)
+// First loop row that goes forward, back to a loop row or holds a finite
+// loop in a finite loop, 0xff if all are fine
+char fx_check(const SIDFX * fx, char n)
 {
-	char* dp = Screen + (max_neffects + 1) * 40;
-	char* cp = Color + (max_neffects + 1) * 40;
+	for(char i=0; i<n; i++)
+	{
+		const SIDFX	&	l = fx[i];
+		if (vsid_isloop(l))
+		{
+			if (l.freq >= i || vsid_isloop(fx[l.freq]))
+				return i;
+			if (l.time1)
+			{
+				for(char j=l.freq; j<i; j++)
+				{
+					if (vsid_isloop(fx[j]) && fx[j].time1)
+						return i;
+				}
+			}
+		}
+	}
+	return 0xff;
+}
 
-	for(char i=0; i<40; i++)
+// Check the loops of all voices, the first bad one is left for the main
+// loop to report
+bool fx_valid(void)
+{
+	for(char ch=0; ch<3; ch++)
 	{
-		dp[i] = MenuRow[i];
-		cp[i] = VCOL_LT_BLUE;
+		fx_bad = fx_check(voice_fx[ch], voice_nrows(ch));
+		if (fx_bad != 0xff)
+		{
+			fx_bad_voice = ch;
+			fx_bad_done = true;
+			return false;
+		}
 	}
-    showdrive();
+	return true;
 }
 
-void hires_draw_start(void);
+// The packed rows of the voices one after the other, the same rows always
+// end up in the same place so a packed export can go on while they are
+// packed again to be played
+unsigned	pack_ofs[4];
 
-void showfxs_row(char n)
+unsigned fx_pack(void)
 {
-	char * dp = Screen + 40 * (n + 1);
-	char * cp = Color + 40 * (n + 1);
-
-	for(char i=0; i<40; i++)
+	unsigned	size = 0;
+	for(char ch=0; ch<3; ch++)
 	{
-		dp[i] = SidRow[i];
-		cp[i] = VCOL_DARK_GREY;
+		pack_ofs[ch] = size;
+		size += sfxpack_encode(PackBuf + size, voice_fx[ch], voice_nrows(ch));
 	}
+	pack_ofs[3] = size;
+	return size;
+}
 
-	if (n < neffects)
+void fx_stop(void)
+{
+	for(char ch=0; ch<3; ch++)
 	{
-		char fs[6];
-		dp[0] = n < 10 ? '0' + n : S'a' + n - 10;
-		cp[0] = VCOL_YELLOW;
-
-		SIDFX	&	s = effects[n];
-		if (s.ctrl & SID_CTRL_TRI)   cp[2] = VCOL_YELLOW;
-		if (s.ctrl & SID_CTRL_SAW)   cp[3] = VCOL_YELLOW;
-		if (s.ctrl & SID_CTRL_RECT)  cp[4] = VCOL_YELLOW;
-		if (s.ctrl & SID_CTRL_NOISE) cp[5] = VCOL_YELLOW;
-		if (s.ctrl & SID_CTRL_GATE)  cp[6] = VCOL_YELLOW;
+		sidfx_stop(ch);
+		sfxpack_stop(ch);
+	}
+}
 
-		uto5digit(s.freq, fs);
-		for(char i=0; i<5; i++)
-		{
-			dp[8 + i] = fs[i];
-			cp[8 + i] = VCOL_LT_GREY;
-		}
+// Start the packed rows of all voices
+void fx_play_packed(void)
+{
+	for(char ch=0; ch<3; ch++)
+	{
+		if (voice_nrows(ch))
+			sfxpack_play(ch, PackBuf + pack_ofs[ch]);
+	}
+}
 
-		uto5digit(s.pwm, fs);
-		for(char i=0; i<4; i++)
-		{
-			dp[14 + i] = fs[i + 1];
-			cp[14 + i] = VCOL_LT_GREY;
-		}
+// Start all voices together, false if a loop cannot be played
+bool fx_play(void)
+{
+	fx_stop();
 
-		if (s.dfreq < 0)
-		{
-			uto5digit(- s.dfreq, fs);
-			for(char i=0; i<5; i++)
-			{
-				dp[24 + i] = fs[i];
-				cp[24 + i] = VCOL_ORANGE;
-			}				
-		}
-		else
-		{
-			uto5digit(s.dfreq, fs);
-			for(char i=0; i<5; i++)
-			{
-				dp[24 + i] = fs[i];
-				cp[24 + i] = VCOL_LT_GREY;
-			}								
-		}
+	bool	loops = fx_any_loop();
+	if (loops)
+	{
+		if (!fx_valid())
+			return false;
+		fx_pack();
+	}
 
-		if (s.dpwm < 0)
-		{
-			uto5digit(- s.dpwm, fs);
-			for(char i=0; i<4; i++)
-			{
-				dp[30 + i] = fs[i + 1];
-				cp[30 + i] = VCOL_ORANGE;
-			}				
-		}
+	for(char ch=0; ch<3; ch++)
+	{
+		char	n = voice_nrows(ch);
+		if (!n)
+			;
+		else if (loops && fx_has_loop(voice_fx[ch], n))
+			sfxpack_play(ch, PackBuf + pack_ofs[ch]);
 		else
-		{
-			uto5digit(s.dpwm, fs);
-			for(char i=0; i<4; i++)
-			{
-				dp[30 + i] = fs[i + 1];
-				cp[30 + i] = VCOL_LT_GREY;
-			}								
-		}
-
-		dp[19] = HexDigit[s.attdec >> 4];   cp[19] = VCOL_YELLOW;
-		dp[20] = HexDigit[s.attdec & 0x0f]; cp[20] = VCOL_YELLOW;
-		dp[21] = HexDigit[s.susrel >> 4];   cp[21] = VCOL_YELLOW;
-		dp[22] = HexDigit[s.susrel & 0x0f]; cp[22] = VCOL_YELLOW;
+			sidfx_play(ch, voice_fx[ch], n);
+	}
+	return true;
+}
 
-		uto5digit(s.time1, fs);
-		for(char i=0; i<2; i++)
-		{
-			dp[35 + i] = fs[i + 3];
-			cp[35 + i] = VCOL_LT_GREY;
-		}
-		uto5digit(s.time0, fs);
-		for(char i=0; i<2; i++)
-		{
-			dp[38 + i] = fs[i + 3];
-			cp[38 + i] = VCOL_LT_GREY;
-		}
+inline bool fx_idle(char ch)
+{
+	return sidfx_idle(ch) && sfxpack_idle(ch);
+}
 
+inline bool fx_all_idle(void)
+{
+	return fx_idle(0) && fx_idle(1) && fx_idle(2);
+}
 
-	}		
+// Effect row on voice ch
+inline char fx_row(char ch)
+{
+	return sfxpack_idle(ch) ? voice_nrows(ch) - 1 - sidfx_cnt(ch) : sfxpack_row(ch);
 }
 
-void showfxs(void)
+// Live tweak mode loops the effect row under the cursor on the voice with
+// the editor's own tick handler. Changed values are written to the SID on
+// the next tick and the gate is never toggled, so edits are heard without
+// a new attack.
+bool		live_mode, live_fresh;
+char		live_row, live_cnt;
+unsigned	live_freq, live_pwm;
+SIDFX		live_fx;
+
+void live_tick(void)
 {
-	char * dp = Screen;
-	char * cp = Color;
+	// wait for sidfx to finish resetting the voice
+	if (!fx_idle(voice) || live_row >= neffects)
+		return;
 
-	for(char i=0; i<40; i++)
+	const SIDFX	&	fx = effects[live_row];
+
+	// restart the sweep when the base values change or a pass is over
+	char	len = fx.time1 + fx.time0;
+	if (live_fresh || fx.freq != live_fx.freq || fx.pwm != live_fx.pwm || (len && live_cnt >= len))
 	{
-		dp[i] = SidHead[i];
-		cp[i] = VCOL_LT_BLUE;
+		live_freq = fx.freq;
+		live_pwm = fx.pwm;
+		live_cnt = 0;
+		irq_cnt = 0;
+	}
+	else
+	{
+		live_freq += fx.dfreq;
+		live_pwm += fx.dpwm;
 	}
+	live_cnt++;
 
-	for(char i=0; i<max_neffects; i++)
-		showfxs_row(i);
+	sid.voices[voice].freq = live_freq;
+	sid.voices[voice].pwm = live_pwm;
+
+	if (live_fresh || fx.attdec != live_fx.attdec)
+		sid.voices[voice].attdec = fx.attdec;
+	if (live_fresh || fx.susrel != live_fx.susrel)
+		sid.voices[voice].susrel = fx.susrel;
+	if (live_fresh || fx.ctrl != live_fx.ctrl)
+		sid.voices[voice].ctrl = fx.ctrl;
+
+	live_fx = fx;
+	live_fresh = false;
 }
 
-char kscan_digits[] = {
-	KSCAN_0,
-	KSCAN_1,
-	KSCAN_2,
-	KSCAN_3,
-	KSCAN_4,
-	KSCAN_5,
-	KSCAN_6,
-	KSCAN_7,
-	KSCAN_8,
-	KSCAN_9,
-	KSCAN_A,
-	KSCAN_B,
-	KSCAN_C,
-	KSCAN_D,
-	KSCAN_E,
-	KSCAN_F
-};
+void live_start(char row)
+{
+	sidfx_stop(voice);
+	sfxpack_stop(voice);
+	live_row = row;
+	live_fresh = true;
+	live_mode = true;
+}
 
-void check_digit(SIDFX & s, char d)
+void live_stop(void)
 {
-	switch (cursorX)
+	live_mode = false;
+	sid.voices[voice].ctrl = live_fx.ctrl & ~SID_CTRL_GATE;
+}
+
+// Runtime cost of the current effects, measured by playing all voices once
+// and timing every sidfx_loop_2() call until they are idle again, then
+// the same for the packed rows and sfxpack_loop(). Effects with loops are
+// only timed packed and for at most cost_max_ticks.
+static const unsigned cost_max_ticks = 1000;
+
+bool			cost_run, cost_done, cost_valid, cost_pack;
+unsigned		cost_ticks, cost_max;
+unsigned long	cost_sum;
+unsigned		pack_ticks, pack_max, pack_size;
+unsigned long	pack_sum;
+
+void cost_start(void)
+{
+	fx_stop();
+	cost_ticks = 0;
+	cost_max = 0;
+	cost_sum = 0;
+	pack_ticks = 0;
+	pack_max = 0;
+	pack_sum = 0;
+	pack_size = fx_pack();
+	cost_pack = false;
+	cost_done = false;
+
+	if (fx_any_loop())
 	{
-		case 19: s.attdec = (s.attdec & 0x0f) | (d << 4); break;
-		case 20: s.attdec = (s.attdec & 0xf0) | d; break;
-		case 21: s.susrel = (s.susrel & 0x0f) | (d << 4); break;
-		case 22: s.susrel = (s.susrel & 0xf0) | d; break;
+		if (!fx_valid())
+			return;
+		fx_play_packed();
+		cost_pack = true;
 	}
-
-	if (d < 10)
+	else
 	{
-		switch (cursorX)
+		for(char ch=0; ch<3; ch++)
 		{
-		case 8:  s.freq = s.freq % 10000 + d * 10000; cursorX++; break;
-		case 9:  s.freq = s.freq % 1000 + (s.freq / 10000) * 10000 + d * 1000; cursorX++; break;
-		case 10: s.freq = s.freq % 100 + (s.freq / 1000) * 1000 + d * 100; cursorX++; break;
-		case 11: s.freq = s.freq % 10 + (s.freq / 100) * 100 + d * 10; cursorX++; break;
-		case 12: s.freq = (s.freq / 10 * 10) + d; break;
-
-		case 14: s.pwm = s.pwm % 1000 + (s.pwm / 10000) * 10000 + d * 1000; cursorX++; break;
-		case 15: s.pwm = s.pwm % 100 + (s.pwm / 1000) * 1000 + d * 100; cursorX++; break;
-		case 16: s.pwm = s.pwm % 10 + (s.pwm / 100) * 100 + d * 10; cursorX++; break;
-		case 17: s.pwm = (s.pwm / 10 * 10) + d; break;
-
-		case 35: s.time1 = s.time1 % 10 + d * 10; cursorX++; break;
-		case 36: s.time1 = (s.time1 / 10 * 10) + d; break;
-
-		case 38: s.time0 = s.time0 % 10 + d * 10; cursorX++; break;
-		case 39: s.time0 = (s.time0 / 10 * 10) + d; break;
+			if (voice_nrows(ch))
+				sidfx_play(ch, voice_fx[ch], voice_nrows(ch));
 		}
 	}
+	irq_cnt = 0;
+	cost_run = true;
 }
 
-void edit_filename(char * fn)
+// Envelope validation plays the effects and samples ENV3 and OSC3 of the
+// voice before every tick, they are compared with the preview model once
+// the run is complete
+static const char valid_ticks = 80;
+
+bool		valid_run, valid_done, valid_shown;
+char		valid_cnt;
+char		valid_env[valid_ticks], valid_osc[valid_ticks];
+
+void valid_plot(void);
+
+void valid_start(void)
 {
-	char * dp = Screen + (max_neffects + 1) * 40;
-	char i = 0;
-	while (dp[21 + i] != S'.' && dp[21 + i] != S']')
+	// the overlay of the last run has to go while its samples are known
+	if (valid_shown)
 	{
-		char ch = dp[21 + i];
-		if (ch >= '0' && ch <= '9' || ch == '-')
-			fn[i] = ch;
-		else if (ch >= S'A' && ch <= S'Z')
-			fn[i] = ch + p'a' - S'A';
-		i++;
+		valid_plot();
+		valid_shown = false;
 	}
-	fn[i] = 0;
+
+	valid_cnt = 0;
+	valid_done = false;
+	if (!fx_play())
+		return;
+	irq_cnt = 0;
+	valid_run = true;
 }
 
-void show_msg(const char* msg, bool petscii = false)
+// Values read before tick n+1 are the state the model has after tick n
+inline void valid_sample(void)
 {
-	save_menu();
-	char* sp      = Screen + (max_neffects + 1) * 40;
-	char* cp      = Color + (max_neffects + 1) * 40;
-	bool  msg_end = false;
-	for (char i = 0; i < 40; i++)
+	if (valid_cnt)
 	{
-		char ch = msg[i];
-		if (!ch)
+		valid_env[valid_cnt - 1] = sid.env3;
+		valid_osc[valid_cnt - 1] = sid.random;
+		if (valid_cnt == valid_ticks)
 		{
-			msg_end = true;
+			valid_run = false;
+			valid_done = true;
+			return;
 		}
-		if (petscii && ch >= 64) ch -= 64;
-		sp[i] = msg_end ? S' ' : ch;
-		cp[i] = VCOL_RED;
 	}
-	msg_cnt = 100; // restore menu after 2secs
+	valid_cnt++;
 }
 
-char filenum = 2;
-char filechannel = 2;
+// Stress test, every voice with rows is started again every stress_every
+// ticks plus 0 to stress_rnd ticks, whether it is still playing or not,
+// and the cycles the players take per tick go into a histogram. The
+// offsets come from a fixed seed, so the same rows, settings and tick
+// rate give the same run.
+static const char stress_buckets = 15;
+static const char stress_shift = 7;		// 128 cycles per bucket
+
+bool			stress_run, stress_reset;
+char			stress_every = 8, stress_rnd = 8;
+char			stress_sel;		// 0 interval, 1 random offset
+char			stress_frames;
+bool			stress_packed[3];
+unsigned		stress_wait[3];
+unsigned		stress_seed, stress_last;
+unsigned		stress_ticks, stress_max, stress_miss;
+unsigned long	stress_sum;
+unsigned		stress_hist[stress_buckets];
+
+// 16 bit xorshift
+char stress_random(void)
+{
+	stress_seed ^= stress_seed << 7;
+	stress_seed ^= stress_seed >> 9;
+	stress_seed ^= stress_seed << 8;
+	return stress_seed & 0xff;
+}
 
-char drive_status[40];
-void read_drive_status(void)
+inline char stress_offset(void)
 {
-    memset(drive_status, 0, 40);
-	krnio_setnam("");
-	krnio_open(15, drive, 15);
-    char n = krnio_read(15, drive_status, 40);
-    // trim off trailing CR
-    if (n > 0 && drive_status[n-1] == 13) drive_status[n-1] = 0;
-    krnio_close(15);
+	return ((unsigned)stress_random() * (stress_rnd + 1)) >> 8;
 }
 
-void edit_load(void)
+// Count lost ticks and start the voices that are due, before the players
+void stress_trigger(void)
+{
+	unsigned	now = cycles_now();
+
+	if (stress_reset)
+	{
+		fx_stop();
+		stress_seed = 0xace1;
+		stress_ticks = 0;
+		stress_max = 0;
+		stress_miss = 0;
+		stress_sum = 0;
+		for(char i=0; i<stress_buckets; i++)
+			stress_hist[i] = 0;
+		for(char ch=0; ch<3; ch++)
+			stress_wait[ch] = 1 + stress_offset();
+		stress_reset = false;
+	}
+	else if (stress_ticks != 0xffff)
+	{
+		// the timer counts down, a gap of more than one and a half ticks
+		// since the last one lost a tick
+		unsigned	d = stress_last - now;
+		while (d > tick_cycles + (tick_cycles >> 1))
+		{
+			stress_miss++;
+			d -= tick_cycles;
+		}
+	}
+	stress_last = now;
+
+	for(char ch=0; ch<3; ch++)
+	{
+		char	n = voice_nrows(ch);
+		if (n && !--stress_wait[ch])
+		{
+			if (stress_packed[ch])
+				sfxpack_play(ch, PackBuf + pack_ofs[ch]);
+			else
+				sidfx_play(ch, voice_fx[ch], n);
+			stress_wait[ch] = stress_every + stress_offset();
+		}
+	}
+}
+
+// The histogram stops when the tick count is full
+inline void stress_add(unsigned t)
+{
+	if (stress_ticks == 0xffff)
+		return;
+
+	stress_ticks++;
+	stress_sum += t;
+	if (t > stress_max)
+		stress_max = t;
+
+	unsigned	b = t >> stress_shift;
+	stress_hist[b < stress_buckets ? b : stress_buckets - 1]++;
+}
+
+void sfx_tick(void)
+{
+	if (valid_run)
+		valid_sample();
+	if (stress_run)
+		stress_trigger();
+
+	if (prof_show || cost_run || stress_run)
+	{
+		unsigned t = cycles_now();
+		// the cost run times one player at a time
+		if (!cost_run || !cost_pack)
+			sidfx_loop_2();
+		if (!cost_run || cost_pack)
+			sfxpack_loop();
+		t -= cycles_now() + prof_bias;
+
+		if (prof_show)
+			prof_add(PROF_SFX, t);
+		if (stress_run)
+			stress_add(t);
+		if (cost_run && cost_pack)
+		{
+			pack_ticks++;
+			pack_sum += t;
+			if (t > pack_max)
+				pack_max = t;
+			if (fx_all_idle() || pack_ticks == cost_max_ticks)
+			{
+				fx_stop();
+				cost_run = false;
+				cost_pack = false;
+				cost_done = true;
+			}
+		}
+		else if (cost_run)
+		{
+			cost_ticks++;
+			cost_sum += t;
+			if (t > cost_max)
+				cost_max = t;
+			if (fx_all_idle())
+			{
+				fx_play_packed();
+				cost_pack = true;
+			}
+		}
+	}
+	else
+	{
+		sidfx_loop_2();
+		sfxpack_loop();
+	}
+
+	if (live_mode)
+		live_tick();
+}
+
+const char SidHead[] = S"  TSRNG FREQ  PWM  ADSR DFREQ DPWM T1 T0";
+const char SidRow[]  = S"# TSRNG 00000 0000 0000 00000 0000 00 00";
+const char LoopRow[] = S"# LOOP  ROW00                      00   ";
+const char MenuRow[] = S"LOAD SAVE NEW  D09  [..............]    ";
+
+const char HexDigit[] = S"0123456789ABCDEF";
+
+
+static const unsigned DecPow[4] = {10000, 1000, 100, 10};
+
+// Decimal conversion by repeated subtraction of the powers of ten, the
+// 6502 has no divide and the library % and / dominate a screen redraw
+void uto5digit(unsigned u, char * d)
+{
+	for(char i=0; i<4; i++)
+	{
+		unsigned	p = DecPow[i];
+		char		c = 48;
+		while (u >= p)
+		{
+			u -= p;
+			c++;
+		}
+		d[i] = c;
+	}
+	d[4] = u + 48;
+}
+
+// Two digit variant for times and drive number, shows value modulo 100
+void uto2digit(char u, char * d)
+{
+	while (u >= 100)
+		u -= 100;
+	char c = 48;
+	while (u >= 10)
+	{
+		u -= 10;
+		c++;
+	}
+	d[0] = c;
+	d[1] = u + 48;
+}
+
+#ifdef OSFXEDIT_BENCH
+// Division based conversion as it was before, kept to measure against
+void uto5digit_div(unsigned u, char * d)
+{
+	for(signed char i=4; i>=0; i--)
+	{
+		d[i] = u % 10 + 48;
+		u /= 10;
+	}
+}
+#endif
+
+// Packed BCD shadow of the decimal fields of each effect row on screen, two
+// digits per byte with the last digit of each field in a low nibble. The
+// screen is painted from it and digit entry only changes a nibble and adds
+// the difference of the digit weights to the binary SIDFX value. It moves
+// with the screen lines when the view scrolls.
+enum BcdFieldId
+{
+	BCD_NONE,
+	BCD_FREQ,
+	BCD_PWM,
+	BCD_DFREQ,
+	BCD_DPWM,
+	BCD_TIME1,
+	BCD_TIME0
+};
+
+struct SidBcd
+{
+	char	b[12];
+};
+
+SidBcd	view_bcd[view_rows];
+
+// First nibble, number of digits and first screen column of each field
+static const char BcdFirst[7]  = {0, 1,  6, 11, 16, 20, 22};
+static const char BcdDigits[7] = {0, 5,  4,  5,  4,  2,  2};
+static const char BcdCol[7]    = {0, 8, 14, 24, 30, 35, 38};
+
+// Field under each screen column of an effect row
+static const char BcdField[40] = {
+	0, 0, 0, 0, 0, 0, 0, 0,
+	BCD_FREQ, BCD_FREQ, BCD_FREQ, BCD_FREQ, BCD_FREQ, 0,
+	BCD_PWM, BCD_PWM, BCD_PWM, BCD_PWM, 0,
+	0, 0, 0, 0, 0,
+	BCD_DFREQ, BCD_DFREQ, BCD_DFREQ, BCD_DFREQ, BCD_DFREQ, 0,
+	BCD_DPWM, BCD_DPWM, BCD_DPWM, BCD_DPWM, 0,
+	BCD_TIME1, BCD_TIME1, 0,
+	BCD_TIME0, BCD_TIME0
+};
+
+// Value of digit d at each decimal place, the 10000 place modulo 65536 just
+// like the 16 bit field it is added to
+static const unsigned DigitWeight[5][10] = {
+	{0, 1, 2, 3, 4, 5, 6, 7, 8, 9},
+	{0, 10, 20, 30, 40, 50, 60, 70, 80, 90},
+	{0, 100, 200, 300, 400, 500, 600, 700, 800, 900},
+	{0, 1000, 2000, 3000, 4000, 5000, 6000, 7000, 8000, 9000},
+	{0, 10000, 20000, 30000, 40000, 50000, 60000, 4464, 14464, 24464}
+};
+
+inline char bcd_get(const SidBcd & bcd, char nib)
+{
+	char c = bcd.b[nib >> 1];
+	return (nib & 1) ? c & 0x0f : c >> 4;
+}
+
+inline void bcd_set(SidBcd & bcd, char nib, char d)
+{
+	char & c = bcd.b[nib >> 1];
+	if (nib & 1)
+		c = (c & 0xf0) | d;
+	else
+		c = (c & 0x0f) | (d << 4);
+}
+
+unsigned bcd_source(const SIDFX & s, char f)
+{
+	switch (f)
+	{
+	case BCD_FREQ:  return s.freq;
+	case BCD_PWM:   return s.pwm;
+	case BCD_DFREQ: return s.dfreq < 0 ? -s.dfreq : s.dfreq;
+	case BCD_DPWM:  return s.dpwm < 0 ? -s.dpwm : s.dpwm;
+	case BCD_TIME1: return s.time1;
+	case BCD_TIME0: return s.time0;
+	}
+	return 0;
+}
+
+// Rebuild one field of the shadow of effect row n from the binary value,
+// the row has to be in view
+void bcd_sync_field(char n, char f)
+{
+	char	fs[5];
+	uto5digit(bcd_source(effects[n], f), fs);
+
+	SidBcd	&	bcd = view_bcd[n - view_top];
+	char nib = BcdFirst[f];
+	for(char i=5 - BcdDigits[f]; i<5; i++)
+		bcd_set(bcd, nib++, fs[i] - 48);
+}
+
+void bcd_sync_row(char n)
+{
+	for(char f=BCD_FREQ; f<=BCD_TIME0; f++)
+		bcd_sync_field(n, f);
+}
+
+// Copy the digits of a field from the shadow to the screen
+void bcd_show(char * dp, const SidBcd & bcd, char f)
+{
+	char nib = BcdFirst[f];
+	dp += BcdCol[f];
+	for(char i=0; i<BcdDigits[f]; i++)
+		dp[i] = 48 + bcd_get(bcd, nib + i);
+}
+
+char cursorX, cursorY;
+char drive = 9; // vice defaults to an iecdrive9 on host file system, which is a convenient use case
+bool fast_io;   // load through the fast loader, F instead of D in the menu
+
+void showdrive(void)
+{
+	char* dp = Screen + (view_rows + 1) * 40;
+	char* cp = Color + (view_rows + 1) * 40;
+    
+    char fs[2];
+	uto2digit(drive, fs);
+	dp[15] = fast_io ? S'F' : S'D';
+	for (char i = 0; i < 2; i++)
+	{
+		dp[16 + i] = fs[i];
+		cp[16 + i] = VCOL_LT_BLUE;
+	}
+}
+
+// Time of day clock of CIA1 in tenths of seconds, it keeps running with
+// the interrupts off during disk transfers
+void tod_init(void)
+{
+	if (sys_pal)
+		cia1.cra |= 0x80;
+	else
+		cia1.cra &= 0x7f;
+	cia1.crb &= 0x7f;
+	cia1.todh = 0;
+	cia1.todm = 0;
+	cia1.tods = 0;
+	cia1.todt = 0;
+}
+
+unsigned tod_tenths(void)
+{
+	// reading the hours latches the clock until the tenths are read
+	(void)cia1.todh;
+	char m = cia1.todm, s = cia1.tods, t = cia1.todt;
+	return ((m >> 4) * 10 + (m & 15)) * 600 + ((s >> 4) * 10 + (s & 15)) * 10 + t;
+}
+
+// Tenths of seconds since t0, the clock wraps every hour
+unsigned tod_since(unsigned t0)
+{
+	unsigned t = tod_tenths();
+	return t >= t0 ? t - t0 : t + 36000 - t0;
+}
+
+// PAL has 312 raster lines and NTSC 263, only PAL gets far beyond line 256
+bool detect_pal(void)
+{
+	char	m = 0;
+	while (vic.ctrl1 & VIC_CTRL1_RST8)
+		;
+	while (!(vic.ctrl1 & VIC_CTRL1_RST8))
+		;
+	while (vic.ctrl1 & VIC_CTRL1_RST8)
+	{
+		if (vic.raster > m)
+			m = vic.raster;
+	}
+	return m > 40;
+}
+
+inline unsigned long sys_clock(void)
+{
+	return sys_pal ? 985248 : 1022727;
+}
+
+// Switch the tick source and recompute the preview step tables for the
+// new tick length, given to them in 8.8 fixed point ms
+void tick_set(bool nmi)
+{
+	if (nmi)
+	{
+		vic_waitLine(nmi_start_rasterline); // start in consistent place to avoid flicker at hires transition
+		cia2.ta	 = nmi_cycles;
+		cia2.icr = 0b10000001;
+		cia2.cra = 0b00010001;
+		tick_cycles = nmi_cycles;
+	}
+	else
+	{
+		cia2.icr = 0b00000001;
+		cia2.cra = 0b00000000;
+		tick_cycles = sys_pal ? 312 * 63 : 263 * 65;
+	}
+	tick_nmi = nmi;
+
+	vsid_init(tick_cycles * 2560UL / (sys_clock() / 100), tick_cycles);
+}
+
+// Tick rate in Hz at the end of the line at dp
+void showtick_at(char * dp)
+{
+	char hz = (sys_clock() + tick_cycles / 2) / tick_cycles;
+	dp[36] = hz >= 100 ? '0' + hz / 100 : ' ';
+	dp[37] = '0' + hz / 10 % 10;
+	dp[38] = '0' + hz % 10;
+	dp[39] = S'h';
+}
+
+// Tick rate at the end of the menu line
+void showtick(void)
+{
+	showtick_at(Screen + (view_rows + 1) * 40);
+}
+
+void showmenu(void)
+{
+	char* dp = Screen + (view_rows + 1) * 40;
+	char* cp = Color + (view_rows + 1) * 40;
+
+	for(char i=0; i<40; i++)
+	{
+		dp[i] = MenuRow[i];
+		cp[i] = VCOL_LT_BLUE;
+	}
+    showdrive();
+	showtick();
+}
+
+void hires_draw_start(void);
+void hires_draw_from(char row);
+
+// Fields of an effect row that need repainting
+enum FxDirty
+{
+	FXD_NUM		= 0x01,
+	FXD_CTRL	= 0x02,
+	FXD_FREQ	= 0x04,
+	FXD_PWM		= 0x08,
+	FXD_ADSR	= 0x10,
+	FXD_DFREQ	= 0x20,
+	FXD_DPWM	= 0x40,
+	FXD_TIME	= 0x80,
+	FXD_ALL		= 0xff
+};
+
+// Fields that differ between two versions of an effect row
+char fx_diff(const SIDFX & a, const SIDFX & b)
+{
+	char m = 0;
+	if (a.ctrl != b.ctrl)                               m |= FXD_CTRL;
+	if (a.freq != b.freq)                               m |= FXD_FREQ;
+	if (a.pwm != b.pwm)                                 m |= FXD_PWM;
+	if (a.attdec != b.attdec || a.susrel != b.susrel)   m |= FXD_ADSR;
+	if (a.dfreq != b.dfreq)                             m |= FXD_DFREQ;
+	if (a.dpwm != b.dpwm)                               m |= FXD_DPWM;
+	if (a.time1 != b.time1 || a.time0 != b.time0)       m |= FXD_TIME;
+	return m;
+}
+
+// Paint the given fields of effect row n, leaving all other cells alone,
+// rows out of view are skipped
+void showfxs_fields(char n, char mask)
+{
+	char r = n - view_top;
+	if (r >= view_rows)
+		return;
+
+	unsigned t = prof_begin();
+
+	char * dp = Screen + 40 * (r + 1);
+	char * cp = Color + 40 * (r + 1);
+
+	const SIDFX		&	s = effects[n];
+	const SidBcd	&	bcd = view_bcd[r];
+
+	if (mask & FXD_NUM)
+	{
+		dp[0] = HexDigit[n >> 4];
+		dp[1] = HexDigit[n & 0x0f];
+		cp[0] = VCOL_YELLOW;
+		cp[1] = VCOL_YELLOW;
+	}
+
+	// a loop row shows its first row and its passes, all of it is
+	// painted whatever changed
+	if (vsid_isloop(s))
+	{
+		for(char i=2; i<40; i++)
+		{
+			dp[i] = LoopRow[i];
+			cp[i] = VCOL_WHITE;
+		}
+		dp[11] = HexDigit[(s.freq >> 4) & 0x0f];
+		dp[12] = HexDigit[s.freq & 0x0f];
+		cp[11] = VCOL_YELLOW;
+		cp[12] = VCOL_YELLOW;
+		bcd_show(dp, bcd, BCD_TIME1);
+		cp[35] = VCOL_LT_GREY;
+		cp[36] = VCOL_LT_GREY;
+
+		prof_end(PROF_ROW, t);
+		return;
+	}
+
+	if (mask & FXD_CTRL)
+	{
+		cp[2] = (s.ctrl & SID_CTRL_TRI)   ? VCOL_YELLOW : VCOL_DARK_GREY;
+		cp[3] = (s.ctrl & SID_CTRL_SAW)   ? VCOL_YELLOW : VCOL_DARK_GREY;
+		cp[4] = (s.ctrl & SID_CTRL_RECT)  ? VCOL_YELLOW : VCOL_DARK_GREY;
+		cp[5] = (s.ctrl & SID_CTRL_NOISE) ? VCOL_YELLOW : VCOL_DARK_GREY;
+		cp[6] = (s.ctrl & SID_CTRL_GATE)  ? VCOL_YELLOW : VCOL_DARK_GREY;
+	}
+
+	if (mask & FXD_FREQ)
+	{
+		bcd_show(dp, bcd, BCD_FREQ);
+		for(char i=0; i<5; i++)
+			cp[8 + i] = VCOL_LT_GREY;
+	}
+
+	if (mask & FXD_PWM)
+	{
+		bcd_show(dp, bcd, BCD_PWM);
+		for(char i=0; i<4; i++)
+			cp[14 + i] = VCOL_LT_GREY;
+	}
+
+	if (mask & FXD_ADSR)
+	{
+		dp[19] = HexDigit[s.attdec >> 4];   cp[19] = VCOL_YELLOW;
+		dp[20] = HexDigit[s.attdec & 0x0f]; cp[20] = VCOL_YELLOW;
+		dp[21] = HexDigit[s.susrel >> 4];   cp[21] = VCOL_YELLOW;
+		dp[22] = HexDigit[s.susrel & 0x0f]; cp[22] = VCOL_YELLOW;
+	}
+
+	if (mask & FXD_DFREQ)
+	{
+		bcd_show(dp, bcd, BCD_DFREQ);
+		char c = s.dfreq < 0 ? VCOL_ORANGE : VCOL_LT_GREY;
+		for(char i=0; i<5; i++)
+			cp[24 + i] = c;
+	}
+
+	if (mask & FXD_DPWM)
+	{
+		bcd_show(dp, bcd, BCD_DPWM);
+		char c = s.dpwm < 0 ? VCOL_ORANGE : VCOL_LT_GREY;
+		for(char i=0; i<4; i++)
+			cp[30 + i] = c;
+	}
+
+	if (mask & FXD_TIME)
+	{
+		bcd_show(dp, bcd, BCD_TIME1);
+		bcd_show(dp, bcd, BCD_TIME0);
+		for(char i=0; i<2; i++)
+		{
+			cp[35 + i] = VCOL_LT_GREY;
+			cp[38 + i] = VCOL_LT_GREY;
+		}
+	}
+
+	prof_end(PROF_ROW, t);
+}
+
+// Paint effect row n from scratch, also building its BCD shadow
+void showfxs_row(char n)
+{
+	char r = n - view_top;
+	if (r >= view_rows)
+		return;
+
+	char * dp = Screen + 40 * (r + 1);
+	char * cp = Color + 40 * (r + 1);
+
+	for(char i=0; i<40; i++)
+	{
+		dp[i] = SidRow[i];
+		cp[i] = VCOL_DARK_GREY;
+	}
+
+	if (n < neffects)
+	{
+		bcd_sync_row(n);
+		showfxs_fields(n, FXD_ALL);
+	}
+}
+
+// Move screen lines with their BCD shadow, d lines from line from to line
+// to, lines counted from the first effect line
+void showfxs_move(char to, char from, char d)
+{
+	memmove(Screen + 40 * (to + 1), Screen + 40 * (from + 1), 40 * d);
+	memmove(Color + 40 * (to + 1), Color + 40 * (from + 1), 40 * d);
+	memmove(view_bcd + to, view_bcd + from, sizeof(SidBcd) * d);
+}
+
+// Renumber the rows in view from effect row n on
+void showfxs_renumber(char n)
+{
+	for(char r=n - view_top; r<view_rows && view_top + r < neffects; r++)
+		showfxs_fields(view_top + r, FXD_NUM);
+}
+
+// Move the screen lines from row n on one line down after an insert at
+// row n, only the row numbers below need repainting
+void showfxs_insert(char n)
+{
+	char r = n - view_top;
+	if (r + 1 < view_rows)
+		showfxs_move(r + 1, r, view_rows - 1 - r);
+
+	showfxs_renumber(n + 1);
+}
+
+// Move the screen lines below row n one line up after row n was deleted
+void showfxs_delete(char n)
+{
+	char r = n - view_top;
+	if (r + 1 < view_rows)
+		showfxs_move(r, r + 1, view_rows - 1 - r);
+	showfxs_row(view_top + view_rows - 1);
+
+	showfxs_renumber(n);
+}
+
+void showfxs(void)
+{
+	char * dp = Screen;
+	char * cp = Color;
+
+	for(char i=0; i<40; i++)
+	{
+		dp[i] = SidHead[i];
+		cp[i] = VCOL_LT_BLUE;
+	}
+
+	// the voice being edited
+	dp[0] = S'V';
+	dp[1] = '1' + voice;
+	cp[0] = VCOL_WHITE;
+	cp[1] = VCOL_WHITE;
+
+	for(char i=0; i<view_rows; i++)
+		showfxs_row(view_top + i);
+}
+
+// Scroll the view to start at effect row top. Lines still in view are
+// moved in screen memory, so a scroll by one line paints a single row
+// whatever the length of the list.
+void view_set(char top)
+{
+	if (top > view_top && top - view_top < view_rows)
+	{
+		char d = top - view_top;
+		showfxs_move(0, d, view_rows - d);
+		view_top = top;
+		for(char i=view_rows - d; i<view_rows; i++)
+			showfxs_row(top + i);
+	}
+	else if (top < view_top && view_top - top < view_rows)
+	{
+		char d = view_top - top;
+		showfxs_move(d, 0, view_rows - d);
+		view_top = top;
+		for(char i=0; i<d; i++)
+			showfxs_row(top + i);
+	}
+	else if (top != view_top)
+	{
+		view_top = top;
+		for(char i=0; i<view_rows; i++)
+			showfxs_row(top + i);
+	}
+	else
+		return;
+
+	hires_draw_start();
+}
+
+// Keep the cursor row in view
+void view_follow(void)
+{
+	if (cursorY == max_neffects)
+		;
+	else if (cursorY < view_top)
+		view_set(cursorY);
+	else if (cursorY >= view_top + view_rows)
+		view_set(cursorY - (view_rows - 1));
+}
+
+// Turn n rows at p around
+void fx_reverse(SIDFX * p, char n)
+{
+	char i = 0;
+	while (i + 1 < n)
+	{
+		n--;
+		SIDFX	t = p[i];
+		p[i] = p[n];
+		p[n] = t;
+		i++;
+	}
+}
+
+// Edit voice v, its rows are moved behind those of the others by turning
+// the rows from its first one to the end of the pool
+void voice_select(char v)
+{
+	if (live_mode)
+		live_stop();
+	fx_stop();
+	valid_run = false;
+	valid_done = false;
+
+	voice_rows[voice] = neffects;
+
+	SIDFX	*	p = voice_fx[v];
+	char		k = voice_rows[v];
+	char		n = effects + neffects - p;
+
+	fx_reverse(p, k);
+	fx_reverse(p + k, n - k);
+	fx_reverse(p, n);
+	for(char ch=0; ch<3; ch++)
+	{
+		if (voice_fx[ch] > p)
+			voice_fx[ch] -= k;
+	}
+
+	voice = v;
+	effects = p + n - k;
+	voice_fx[v] = effects;
+	neffects = k;
+
+	view_top = 0;
+	if (cursorY < max_neffects && cursorY > neffects)
+		cursorY = neffects;
+	showfxs();
+	hires_draw_start();
+}
+
+// No rows in any voice
+void voice_clear(void)
+{
+	for(char ch=0; ch<3; ch++)
+	{
+		voice_fx[ch] = FxPool;
+		voice_rows[ch] = 0;
+	}
+	effects = FxPool;
+	neffects = 0;
+}
+
+// Loads put the rows of the voices one after the other at the start of the
+// pool, the first n of them came in. The edited voice is kept if it got
+// rows, else it is the first voice that did.
+void voice_loaded(const char * rows, char n)
+{
+	SIDFX	*	p = FxPool;
+	for(char ch=0; ch<3; ch++)
+	{
+		voice_fx[ch] = p;
+		voice_rows[ch] = rows[ch] < n ? rows[ch] : n;
+		n -= voice_rows[ch];
+		p += voice_rows[ch];
+	}
+
+	char v = voice;
+	if (!voice_rows[v])
+	{
+		v = 0;
+		while (v < 2 && !voice_rows[v])
+			v++;
+	}
+
+	// voice 3 is the last one in the pool now
+	voice = 2;
+	effects = voice_fx[2];
+	neffects = voice_rows[2];
+	voice_select(v);
+}
+
+// List overlay over the effect lines, the caller paints the items and
+// gets the picked one
+bool	list_mode;
+char	list_cnt, list_pos, list_top;
+void	(* list_paint)(char i, char * dp);
+void	(* list_pick)(char i);
+
+// Paint list item i if in view, the selected one in white
+void list_line(char i)
+{
+	char r = i - list_top;
+	if (r >= view_rows)
+		return;
+
+	char * dp = Screen + 40 * (r + 1);
+	char * cp = Color + 40 * (r + 1);
+	char c = i == list_pos ? VCOL_WHITE : VCOL_LT_BLUE;
+
+	for(char j=0; j<40; j++)
+	{
+		dp[j] = S' ';
+		cp[j] = c;
+	}
+	if (i < list_cnt)
+		list_paint(i, dp);
+}
+
+void list_show(void)
+{
+	for(char r=0; r<view_rows; r++)
+		list_line(list_top + r);
+}
+
+void list_select(char i)
+{
+	char old = list_pos;
+	list_pos = i;
+
+	if (i < list_top)
+	{
+		list_top = i;
+		list_show();
+	}
+	else if (i >= list_top + view_rows)
+	{
+		list_top = i - (view_rows - 1);
+		list_show();
+	}
+	else
+	{
+		list_line(old);
+		list_line(i);
+	}
+}
+
+// Show the list with its title in the head line
+void list_open(const char * title, char cnt, void (* paint)(char, char *), void (* pick)(char))
+{
+	list_mode = true;
+	list_cnt = cnt;
+	list_pos = 0;
+	list_top = 0;
+	list_paint = paint;
+	list_pick = pick;
+
+	bool end = false;
+	for(char i=0; i<40; i++)
+	{
+		if (!title[i])
+			end = true;
+		Screen[i] = end ? S' ' : title[i];
+		Color[i] = VCOL_WHITE;
+	}
+
+	list_show();
+}
+
+// Cursor keys select, return picks and any other key leaves the list
+void list_key(char k)
+{
+	switch (k)
+	{
+	case KSCAN_CSR_DOWN:
+		if (list_pos + 1 < list_cnt)
+			list_select(list_pos + 1);
+		break;
+	case KSCAN_CSR_DOWN | KSCAN_QUAL_SHIFT:
+		if (list_pos > 0)
+			list_select(list_pos - 1);
+		break;
+	case KSCAN_RETURN:
+		list_mode = false;
+		list_pick(list_pos);
+		break;
+	default:
+		list_mode = false;
+		showfxs();
+		break;
+	}
+}
+
+char kscan_digits[] = {
+	KSCAN_0,
+	KSCAN_1,
+	KSCAN_2,
+	KSCAN_3,
+	KSCAN_4,
+	KSCAN_5,
+	KSCAN_6,
+	KSCAN_7,
+	KSCAN_8,
+	KSCAN_9,
+	KSCAN_A,
+	KSCAN_B,
+	KSCAN_C,
+	KSCAN_D,
+	KSCAN_E,
+	KSCAN_F
+};
+
+// The five FREQ digits hold more than 65535, compared digit by digit
+bool bcd_freq_over(const SidBcd & bcd)
+{
+	static const char	max[5] = {6, 5, 5, 3, 5};
+	for(char i=0; i<5; i++)
+	{
+		char	d = bcd_get(bcd, BcdFirst[BCD_FREQ] + i);
+		if (d != max[i])
+			return d > max[i];
+	}
+	return false;
+}
+
+// Enter digit d at the cursor, returns true if the value changed
+bool check_digit(SIDFX & s, SidBcd & bcd, char d)
+{
+	char	ad = s.attdec, sr = s.susrel;
+
+	switch (cursorX)
+	{
+		case 19: s.attdec = (s.attdec & 0x0f) | (d << 4); break;
+		case 20: s.attdec = (s.attdec & 0xf0) | d; break;
+		case 21: s.susrel = (s.susrel & 0x0f) | (d << 4); break;
+		case 22: s.susrel = (s.susrel & 0xf0) | d; break;
+	}
+
+	if (s.attdec != ad || s.susrel != sr)
+		return true;
+
+	char	f = BcdField[cursorX];
+	if (d < 10 && f != BCD_NONE && f != BCD_DFREQ && f != BCD_DPWM)
+	{
+		char	i = cursorX - BcdCol[f];
+		char	nib = BcdFirst[f] + i;
+		char	old = bcd_get(bcd, nib);
+
+		if (i + 1 < BcdDigits[f])
+			cursorX++;
+
+		if (d != old)
+		{
+			bcd_set(bcd, nib, d);
+
+			char		place = BcdDigits[f] - 1 - i;
+			unsigned	delta = DigitWeight[place][d] - DigitWeight[place][old];
+
+			switch (f)
+			{
+			case BCD_FREQ:
+				s.freq += delta;
+				// beyond 65535, show what the field really holds
+				if (bcd_freq_over(bcd))
+					bcd_sync_field(cursorY, BCD_FREQ);
+				break;
+			case BCD_PWM:
+				s.pwm += delta;
+				break;
+			case BCD_TIME1:
+				s.time1 = DigitWeight[1][bcd_get(bcd, nib & 0xfe)] + bcd_get(bcd, nib | 1);
+				break;
+			case BCD_TIME0:
+				s.time0 = DigitWeight[1][bcd_get(bcd, nib & 0xfe)] + bcd_get(bcd, nib | 1);
+				break;
+			}
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void edit_filename(char * fn)
+{
+	char * dp = Screen + (view_rows + 1) * 40;
+	char i = 0;
+	while (dp[21 + i] != S'.' && dp[21 + i] != S']')
+	{
+		char ch = dp[21 + i];
+		if (ch >= '0' && ch <= '9' || ch == '-' || ch == '/')
+			fn[i] = ch;
+		else if (ch >= S'A' && ch <= S'Z')
+			fn[i] = ch + p'a' - S'A';
+		i++;
+	}
+	fn[i] = 0;
+}
+
+void show_msg(const char* msg, bool petscii = false)
+{
+	save_menu();
+	char* sp      = Screen + (view_rows + 1) * 40;
+	char* cp      = Color + (view_rows + 1) * 40;
+	bool  msg_end = false;
+	for (char i = 0; i < 40; i++)
+	{
+		char ch = msg[i];
+		if (!ch)
+		{
+			msg_end = true;
+		}
+		if (petscii && ch >= 64) ch -= 64;
+		sp[i] = msg_end ? S' ' : ch;
+		cp[i] = VCOL_RED;
+	}
+	msg_cnt = 100; // restore menu after 2secs
+}
+
+#ifdef OSFXEDIT_BENCH
+// Effect row n painted the way it was before the BCD shadow, every number
+// converted with the division based routine
+void showfxs_row_div(char n)
+{
+	char * dp = Screen + 40 * (n - view_top + 1);
+	char * cp = Color + 40 * (n - view_top + 1);
+
+	for(char i=0; i<40; i++)
+	{
+		dp[i] = SidRow[i];
+		cp[i] = VCOL_DARK_GREY;
+	}
+
+	char fs[6];
+	dp[0] = HexDigit[n >> 4];
+	dp[1] = HexDigit[n & 0x0f];
+	cp[0] = VCOL_YELLOW;
+	cp[1] = VCOL_YELLOW;
+
+	const SIDFX	&	s = effects[n];
+	if (s.ctrl & SID_CTRL_TRI)   cp[2] = VCOL_YELLOW;
+	if (s.ctrl & SID_CTRL_SAW)   cp[3] = VCOL_YELLOW;
+	if (s.ctrl & SID_CTRL_RECT)  cp[4] = VCOL_YELLOW;
+	if (s.ctrl & SID_CTRL_NOISE) cp[5] = VCOL_YELLOW;
+	if (s.ctrl & SID_CTRL_GATE)  cp[6] = VCOL_YELLOW;
+
+	uto5digit_div(s.freq, fs);
+	for(char i=0; i<5; i++)
+	{
+		dp[8 + i] = fs[i];
+		cp[8 + i] = VCOL_LT_GREY;
+	}
+
+	uto5digit_div(s.pwm, fs);
+	for(char i=0; i<4; i++)
+	{
+		dp[14 + i] = fs[i + 1];
+		cp[14 + i] = VCOL_LT_GREY;
+	}
+
+	uto5digit_div(s.dfreq < 0 ? - s.dfreq : s.dfreq, fs);
+	for(char i=0; i<5; i++)
+	{
+		dp[24 + i] = fs[i];
+		cp[24 + i] = s.dfreq < 0 ? VCOL_ORANGE : VCOL_LT_GREY;
+	}
+
+	uto5digit_div(s.dpwm < 0 ? - s.dpwm : s.dpwm, fs);
+	for(char i=0; i<4; i++)
+	{
+		dp[30 + i] = fs[i + 1];
+		cp[30 + i] = s.dpwm < 0 ? VCOL_ORANGE : VCOL_LT_GREY;
+	}
+
+	dp[19] = HexDigit[s.attdec >> 4];   cp[19] = VCOL_YELLOW;
+	dp[20] = HexDigit[s.attdec & 0x0f]; cp[20] = VCOL_YELLOW;
+	dp[21] = HexDigit[s.susrel >> 4];   cp[21] = VCOL_YELLOW;
+	dp[22] = HexDigit[s.susrel & 0x0f]; cp[22] = VCOL_YELLOW;
+
+	uto5digit_div(s.time1, fs);
+	for(char i=0; i<2; i++)
+	{
+		dp[35 + i] = fs[i + 3];
+		cp[35 + i] = VCOL_LT_GREY;
+	}
+	uto5digit_div(s.time0, fs);
+	for(char i=0; i<2; i++)
+	{
+		dp[38 + i] = fs[i + 3];
+		cp[38 + i] = VCOL_LT_GREY;
+	}
+}
+
+// Time a full screen of effect rows painted the old way and from the BCD
+// shadow, with the interrupts off, reported in PAL raster lines. The rows
+// are made up for the run, the editor starts with its single row after it.
+void bench_redraw(void)
+{
+	bool	nmi = tick_nmi;
+	if (nmi)
+		tick_set(false);
+
+	neffects = view_rows;
+	for(char i=0; i<view_rows; i++)
+	{
+		SIDFX	&	s = effects[i];
+		s = basefx;
+		s.freq = 1000 + 4321 * i;
+		s.pwm = 273 * i;
+		s.dfreq = 37 - 13 * i;
+		s.dpwm = 11 * i - 80;
+		s.time1 = 7 * i;
+		s.time0 = 3 * i;
+	}
+
+	unsigned long	tdiv = 0, tbcd = 0;
+
+	__asm {sei}
+	for(char i=0; i<view_rows; i++)
+	{
+		unsigned t = cycles_now();
+		showfxs_row_div(view_top + i);
+		tdiv += t - cycles_now();
+	}
+	for(char i=0; i<view_rows; i++)
+	{
+		unsigned t = cycles_now();
+		showfxs_row(view_top + i);
+		tbcd += t - cycles_now();
+	}
+	__asm {cli}
+
+	if (nmi)
+		tick_set(true);
+
+	neffects = 1;
+	effects[0] = basefx;
+	showfxs();
+
+	char	msg[40];
+	sprintf(msg, "REDRAW %u LINES, WITH DIVISION %u", (unsigned)(tbcd / 63), (unsigned)(tdiv / 63));
+	show_msg(msg, true);
+}
+#endif
+
+char filenum = 2;
+char filechannel = 2;
+
+char drive_status[40];
+
+// Read the status from the open command channel, returns the error number
+char drive_error(void)
+{
+    memset(drive_status, 0, 40);
+    char n = krnio_read(15, drive_status, 40);
+    // trim off trailing CR
+    if (n > 0 && drive_status[n-1] == 13) drive_status[n-1] = 0;
+    return (drive_status[0] - '0') * 10 + (drive_status[1] - '0');
+}
+
+void read_drive_status(void)
+{
+	krnio_setnam("");
+	krnio_open(15, drive, 15);
+	drive_error();
+    krnio_close(15);
+}
+
+// The raster irqs, sprites and the NMI tick are off while the drive is
+// talked to
+void io_begin(void)
 {
 	rirq_stop();
 	vic.intr_enable = 0;
 	spr_show(0, false);
 	spr_show(1, false);
 	spr_show(2, false);
-        
-#ifdef OSFXEDIT_USE_NMI
-	cia2.icr = 0b00000001; // disable NMI
-#endif
+
+	if (tick_nmi)
+		cia2.icr = 0b00000001; // disable NMI
+}
+
+void io_end(void)
+{
+	if (tick_nmi)
+		cia2.icr = 0b10000001; // enable NMI
+	spr_show(0, true);
+	spr_show(1, true);
+	spr_show(2, true);
+	vic.intr_enable = 1;
+	rirq_start();
+}
+
+void bank_load(const char * name, const char * entry);
+void bank_save(const char * name, const char * entry, bool packed);
+void dir_add(const char * name);
+void edit_new(void);
+void prof_toggle_off(void);
+
+// Bytes and rate of the last transfer in the menu line
+void io_report(unsigned bytes, unsigned t0, bool fast)
+{
+	unsigned	t = tod_since(t0);
+	char		msg[48];
+
+	if (t)
+		sprintf(msg, "%u BYTES IN %u.%u S, %u B/S %s", bytes, t / 10, t % 10,
+			(unsigned)(bytes * 10UL / t), fast ? "FAST" : "KERNAL");
+	else
+		sprintf(msg, "%u BYTES IN < 0.1 S %s", bytes, fast ? "FAST" : "KERNAL");
+	msg[39] = 0;
+	show_msg(msg, true);
+}
+
+// Fast loader, the drive side is uploaded with M-W to 0x0500 of a 1541
+// and started with M-E. It finds the file in the directory and reads its
+// sectors into buffer 1 with the job queue, then sends each block as a
+// length byte and the data, a length of 0 ends the file and 0xff reports
+// a missing file or a read error. Bytes go two bits at a time on clk and
+// data: the C64 holds data low between bytes, the drive pulls clk once a
+// byte is ready, the C64 releases data and the drive puts the bit pairs
+// out every 20 cycles after seeing that. The screen is blanked for the
+// transfer, badlines would upset the C64 timing.
+//
+//	start:    ldx #18          ; first directory sector
+//	          ldy #1
+//	dirnext:  jsr readts
+//	          bcs fail
+//	          ldx #2
+//	entry:    lda $0400,x      ; file type
+//	          and #$07
+//	          cmp #$02         ; prg
+//	          bne skip
+//	          stx ent
+//	          ldy #0
+//	cmpl:     lda $0403,x
+//	          cmp name,y
+//	          bne nomatch
+//	          inx
+//	          iny
+//	          cpy #16
+//	          bne cmpl
+//	          ldx ent          ; first sector of the file
+//	          lda $0402,x
+//	          tay
+//	          lda $0401,x
+//	          tax
+//	sendnext: jsr readts
+//	          bcs fail
+//	          lda #254
+//	          ldx $0400        ; last sector has track 0 and the end
+//	          bne full
+//	          lda $0401
+//	          sec
+//	          sbc #1
+//	          beq done
+//	full:     sta cnt
+//	          sei
+//	          jsr send
+//	          lda #2
+//	          sta pos
+//	block:    ldx pos
+//	          lda $0400,x
+//	          jsr send
+//	          inc pos
+//	          dec cnt
+//	          bne block
+//	          cli
+//	          ldx $0400
+//	          beq done
+//	          ldy $0401
+//	          jmp sendnext
+//	nomatch:  ldx ent
+//	skip:     txa              ; 8 entries of 32 bytes
+//	          clc
+//	          adc #32
+//	          tax
+//	          bcc entry
+//	          ldx $0400
+//	          beq fail
+//	          ldy $0401
+//	          jmp dirnext
+//	done:     lda #0
+//	          .byte $2c
+//	fail:     lda #$ff
+//	          sei
+//	          jsr send
+//	          cli
+//	          rts
+//	readts:   stx $08          ; job 1
+//	          sty $09
+//	          lda #$80
+//	          sta $01
+//	          cli
+//	rwait:    lda $01
+//	          bmi rwait
+//	          cmp #2
+//	          rts
+//	send:     ldy #0
+//	sprep:    pha
+//	          and #3
+//	          tax
+//	          lda enc,x
+//	          sta p0,y
+//	          pla
+//	          lsr
+//	          lsr
+//	          iny
+//	          cpy #4
+//	          bne sprep
+//	widle:    lda $1800        ; data held low by the C64
+//	          lsr
+//	          bcc widle
+//	          lda #$08         ; clk low, byte ready
+//	          sta $1800
+//	wsync:    lda $1800        ; data released, 9 cycles jitter
+//	          lsr
+//	          bcs wsync
+//	          lda p0           ; 12 cycles after the read
+//	          sta $1800
+//	          nop x 6
+//	          lda p1           ; +20
+//	          sta $1800
+//	          nop x 6
+//	          lda p2           ; +40
+//	          sta $1800
+//	          nop x 6
+//	          lda p3           ; +60
+//	          sta $1800
+//	          nop x 6
+//	          lda #0           ; +78, released
+//	          sta $1800
+//	          rts
+//	enc:      .byte $00, $08, $02, $0a
+//	ent:      .byte 0
+//	cnt:      .byte 0
+//	pos:      .byte 0
+//	p0:       .byte 0, 0, 0, 0
+//	name:     16 bytes, padded with $a0
+static const char FastDrive[] = {
+	0xa2, 0x12, 0xa0, 0x01, 0x20, 0x8f, 0x05, 0xb0, 0x7e, 0xa2, 0x02, 0xbd,
+	0x00, 0x04, 0x29, 0x07, 0xc9, 0x02, 0xd0, 0x5e, 0x8e, 0xfe, 0x05, 0xa0,
+	0x00, 0xbd, 0x03, 0x04, 0xd9, 0x05, 0x06, 0xd0, 0x4e, 0xe8, 0xc8, 0xc0,
+	0x10, 0xd0, 0xf2, 0xae, 0xfe, 0x05, 0xbd, 0x02, 0x04, 0xa8, 0xbd, 0x01,
+	0x04, 0xaa, 0x20, 0x8f, 0x05, 0xb0, 0x50, 0xa9, 0xfe, 0xae, 0x00, 0x04,
+	0xd0, 0x08, 0xad, 0x01, 0x04, 0x38, 0xe9, 0x01, 0xf0, 0x3e, 0x8d, 0xff,
+	0x05, 0x78, 0x20, 0x9f, 0x05, 0xa9, 0x02, 0x8d, 0x00, 0x06, 0xae, 0x00,
+	0x06, 0xbd, 0x00, 0x04, 0x20, 0x9f, 0x05, 0xee, 0x00, 0x06, 0xce, 0xff,
+	0x05, 0xd0, 0xef, 0x58, 0xae, 0x00, 0x04, 0xf0, 0x1b, 0xac, 0x01, 0x04,
+	0x4c, 0x32, 0x05, 0xae, 0xfe, 0x05, 0x8a, 0x18, 0x69, 0x20, 0xaa, 0x90,
+	0x92, 0xae, 0x00, 0x04, 0xf0, 0x09, 0xac, 0x01, 0x04, 0x4c, 0x04, 0x05,
+	0xa9, 0x00, 0x2c, 0xa9, 0xff, 0x78, 0x20, 0x9f, 0x05, 0x58, 0x60, 0x86,
+	0x08, 0x84, 0x09, 0xa9, 0x80, 0x85, 0x01, 0x58, 0xa5, 0x01, 0x30, 0xfc,
+	0xc9, 0x02, 0x60, 0xa0, 0x00, 0x48, 0x29, 0x03, 0xaa, 0xbd, 0xfa, 0x05,
+	0x99, 0x01, 0x06, 0x68, 0x4a, 0x4a, 0xc8, 0xc0, 0x04, 0xd0, 0xee, 0xad,
+	0x00, 0x18, 0x4a, 0x90, 0xfa, 0xa9, 0x08, 0x8d, 0x00, 0x18, 0xad, 0x00,
+	0x18, 0x4a, 0xb0, 0xfa, 0xad, 0x01, 0x06, 0x8d, 0x00, 0x18, 0xea, 0xea,
+	0xea, 0xea, 0xea, 0xea, 0xad, 0x02, 0x06, 0x8d, 0x00, 0x18, 0xea, 0xea,
+	0xea, 0xea, 0xea, 0xea, 0xad, 0x03, 0x06, 0x8d, 0x00, 0x18, 0xea, 0xea,
+	0xea, 0xea, 0xea, 0xea, 0xad, 0x04, 0x06, 0x8d, 0x00, 0x18, 0xea, 0xea,
+	0xea, 0xea, 0xea, 0xea, 0xa9, 0x00, 0x8d, 0x00, 0x18, 0x60, 0x00, 0x08,
+	0x02, 0x0a, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+};
+
+static const unsigned fast_drive_addr = 0x0500;
+static const unsigned fast_name_addr = 0x0605;
+
+static const int FAST_NODRIVE = -1;
+static const int FAST_ERROR = -2;
+
+char	fast_rel, fast_hold;
+char	fast_head[2];
+
+// Write n bytes into the drive memory
+void fast_mw(unsigned addr, const char * data, char n)
+{
+	char cmd[40];
+	cmd[0] = 'M'; cmd[1] = '-'; cmd[2] = 'W';
+	cmd[3] = addr & 0xff;
+	cmd[4] = addr >> 8;
+	cmd[5] = n;
+	memcpy(cmd + 6, data, n);
+	krnio_write(15, cmd, 6 + n);
+}
+
+// Wait for the drive to pull clk, it searches the directory before the
+// first byte, gives up after five seconds
+bool fast_wait(void)
+{
+	unsigned t0 = tod_tenths();
+	while (cia2.pra & 0x40)
+	{
+		if (tod_since(t0) > 50)
+			return false;
+	}
+	return true;
+}
+
+// One byte of the two bit protocol, reads are 26, 46, 66 and 86 cycles
+// after data is released, in the middle of the drive's bit pairs
+char fast_get(void)
+{
+	__asm
+	{
+	wait:
+		bit $dd00
+		bvs wait
+		lda fast_rel
+		sta $dd00
+		nop
+		nop
+		nop
+		nop
+		nop
+		nop
+		nop
+		nop
+		nop
+		nop
+		nop
+		lda $dd00
+		and #$c0
+		lsr
+		lsr
+		sta accu
+		nop
+		nop
+		bit accu
+		lda $dd00
+		and #$c0
+		ora accu
+		lsr
+		lsr
+		sta accu
+		nop
+		nop
+		lda $dd00
+		and #$c0
+		ora accu
+		lsr
+		lsr
+		sta accu
+		nop
+		nop
+		lda $dd00
+		and #$c0
+		ora accu
+		eor #$ff
+		sta accu
+		lda fast_hold
+		sta $dd00
+		lda #0
+		sta accu + 1
+	}
+}
+
+// Load the named file with the fast loader, the version and row count go
+// to fast_head and the rows to the effects. Returns the bytes received,
+// FAST_NODRIVE when no drive code answered (no 1541, or a drive without
+// one such as VICE's host directory drive) or FAST_ERROR.
+int fast_load(const char * name)
+{
+	krnio_setnam("");
+	if (!krnio_open(15, drive, 15))
+		return FAST_NODRIVE;
+
+	for(unsigned i=0; i<sizeof(FastDrive); i+=32)
+		fast_mw(fast_drive_addr + i, FastDrive + i, sizeof(FastDrive) - i < 32 ? sizeof(FastDrive) - i : 32);
+
+	char fn[16];
+	memset(fn, 0xa0, 16);
+	memcpy(fn, name, strlen(name));
+	fast_mw(fast_name_addr, fn, 16);
+
+	static const char exec[5] = {'M', '-', 'E', fast_drive_addr & 0xff, fast_drive_addr >> 8};
+	krnio_write(15, exec, 5);
+
+	__asm {sei}
+	vic.ctrl1 &= ~VIC_CTRL1_DEN;
+	fast_rel = cia2.pra & 0x07;
+	fast_hold = fast_rel | 0x20;
+	cia2.pra = fast_hold;
+
+	// no badlines from the next frame on
+	vic_waitBottom();
+
+	int n = FAST_NODRIVE;
+	if (fast_wait())
+	{
+		n = 0;
+		for(;;)
+		{
+			char len = fast_get();
+			if (!len)
+				break;
+			if (len == 0xff)
+			{
+				n = FAST_ERROR;
+				break;
+			}
+			do {
+				char b = fast_get();
+				if (n < 2)
+					fast_head[n] = b;
+				else if (n < 4 + sizeof(SIDFX) * max_neffects)
+					((char *)FxPool)[n - 2] = b;
+				n++;
+			} while (--len);
+		}
+	}
+
+	cia2.pra = fast_rel;
+	vic.ctrl1 |= VIC_CTRL1_DEN;
+	__asm {cli}
+
+	krnio_close(15);
+	return n;
+}
+
+// Load through the fast loader, returns false if the drive did not answer
+// and the kernal has to do it
+bool edit_load_fast(const char * name, unsigned t0)
+{
+	int n = fast_load(name);
+	if (n == FAST_NODRIVE)
+	{
+		fast_io = false;
+		showdrive();
+		return false;
+	}
+
+	if (n == FAST_ERROR)
+	{
+		show_msg(S"could not read from file");
+		return true;
+	}
+	if (n < 2 || (fast_head[0] > 0xb3 && fast_head[0] != file_version))
+	{
+		show_msg(S"incorrect file version");
+		return true;
+	}
+
+	// the counts of voice 2 and 3 went in front of the rows
+	char	*	dp = (char *)FxPool;
+	char		rows[3];
+	char		head = 2;
+	if (fast_head[0] == file_version)
+	{
+		rows[0] = fast_head[1];
+		rows[1] = dp[0];
+		rows[2] = dp[1];
+		head = 4;
+	}
+	else
+	{
+		rows[0] = rows[1] = 0;
+		rows[2] = fast_head[1];
+	}
+
+	unsigned	size = sizeof(SIDFX) * (rows[0] + rows[1] + rows[2]);
+	if (n < head + size || size > sizeof(SIDFX) * max_neffects)
+		show_msg(S"file too short");
+	else
+	{
+		if (head == 4)
+			memmove(dp, dp + 2, size);
+		cost_valid = false;
+		voice_loaded(rows, max_neffects);
+		view_top = 0;
+		io_report(n, t0, true);
+	}
+	return true;
+}
+
+// KERNAL loads, saves and the .c export run as a job of the main loop. The
+// file is opened up front, then each frame moves bytes for io_budget
+// cycles with the raster irqs, sprites and keyboard running. The NMI tick
+// is only held off while a byte is on the bus, a tick inside the kernal's
+// bit loop breaks the serial timing.
+enum IOJob
+{
+	IOJ_NONE,
+	IOJ_LOAD,
+	IOJ_SAVE,
+	IOJ_EXPORT
+};
+
+static const unsigned io_budget = 8000;
+
+IOJob		io_job;
+char	*	io_ptr;
+unsigned	io_left;
+unsigned	io_pos, io_total;
+unsigned	io_bytes, io_t0;
+unsigned	io_row;
+char		io_vrows[3];	// rows of each voice in the file loaded
+char		io_name[16];
+char		io_line[100];
+bool		io_packed;		// export the packed stream of sfxpack.h
+const char *	io_pack;
+const SIDFX *	io_fxp;			// rows of the voice being exported
+char		io_n, io_voice;
+char		io_voices;		// voices still to export, a bit each
+bool		io_multi;		// arrays are named after their voice
+unsigned	io_lines;		// lines of the voice being exported
+char		io_fx, io_loop;	// row and loop passes of the plain export
+unsigned	io_out;			// rows of the plain export
+char		io_chunk;		// voices saved
+
+static const char IOLabel[4][7] = {S"", S"LOAD  ", S"SAVE  ", S"EXPORT"};
+
+char io_getch(void)
+{
+	if (tick_nmi)
+		cia2.icr = 0b00000001;
+	char ch = krnio_chrin();
+	if (tick_nmi)
+		cia2.icr = 0b10000001;
+	return ch;
+}
+
+void io_putch(char ch)
+{
+	if (tick_nmi)
+		cia2.icr = 0b00000001;
+	krnio_chrout(ch);
+	if (tick_nmi)
+		cia2.icr = 0b10000001;
+}
+
+// Label and a bar of 32 cells in the menu line
+void io_bar(void)
+{
+	char * dp = Screen + (view_rows + 1) * 40;
+	char * cp = Color + (view_rows + 1) * 40;
+
+	char n = io_total ? (unsigned long)io_pos * 32 / io_total : 0;
+	for(char i=0; i<6; i++)
+		dp[i] = IOLabel[io_job][i];
+	dp[6] = S' ';
+	for(char i=0; i<32; i++)
+		dp[7 + i] = i < n ? 0xa0 : S'.';
+	dp[39] = S' ';
+	for(char i=0; i<40; i++)
+		cp[i] = VCOL_GREEN;
+}
+
+// The menu line carries the bar while a job runs, a message or the
+// profiler are taken off it first
+void io_start(IOJob job)
+{
+	if (msg_cnt)
+	{
+		msg_cnt = 0;
+		restore_menu();
+	}
+	if (prof_show)
+		prof_toggle_off();
+	if (!io_job)
+		save_menu();
+
+	io_job = job;
+	io_pos = 0;
+	io_bar();
+}
+
+void io_close(void)
+{
+	io_begin();
+	krnio_clrchn();
+	krnio_close(filenum);
+	io_end();
+}
+
+// Ends the job, the menu is back before any message goes over it
+void io_stop(void)
+{
+	io_job = IOJ_NONE;
+	restore_menu();
+}
+
+// Row of the plain export after row pos, sidfx has no loops so the
+// finite ones are written out pass by pass
+char io_unroll(char pos)
+{
+	pos++;
+	while (pos < io_n && vsid_isloop(io_fxp[pos]))
+	{
+		const SIDFX	&	l = io_fxp[pos];
+		if (!io_loop)
+			io_loop = l.time1;
+		io_loop--;
+		pos = io_loop ? l.freq : pos + 1;
+	}
+	return pos;
+}
+
+// Rows of the plain export of voice ch after the loops were checked, more
+// than 255 if it does not fit or a loop runs forever
+unsigned io_unroll_rows(char ch)
+{
+	io_fxp = voice_fx[ch];
+	io_n = voice_nrows(ch);
+
+	for(char i=0; i<io_n; i++)
+	{
+		if (vsid_isloop(io_fxp[i]) && !io_fxp[i].time1)
+			return 256;
+	}
+
+	unsigned	cnt = 0;
+
+	io_loop = 0;
+	for(char r=0; r<io_n && cnt <= 255; r=io_unroll(r))
+		cnt++;
+	return cnt;
+}
+
+// Start the array of the next voice, false when all are out
+bool io_export_next(void)
+{
+	char ch = 0;
+	while (ch < 3 && !(io_voices & (1 << ch)))
+		ch++;
+	if (ch == 3)
+		return false;
+
+	io_voices &= ~(1 << ch);
+	io_voice = ch;
+	if (io_packed)
+	{
+		io_fxp = voice_fx[ch];
+		io_n = voice_nrows(ch);
+		io_pack = PackBuf + pack_ofs[ch] + 1;
+		io_lines = io_n + 4;
+	}
+	else
+	{
+		io_out = io_unroll_rows(ch);
+		io_lines = io_out + 3;
+	}
+	io_row = 0;
+	io_fx = 0;
+	io_loop = 0;
+	return true;
+}
+
+// Export not possible, a save before it is done
+void io_refuse(const char * msg)
+{
+	if (io_job)
+		io_stop();
+	show_msg(msg);
+}
+
+// Open name.c and write the rows of the voices in the mask as C arrays
+// SFX_<name> into it, or as packed streams SFXP_<name>, with _<voice>
+// after the name if there are several. The lines are made when the
+// previous one is out.
+void edit_export(const char * name, bool packed, char voices)
+{
+	char fname[24];
+
+	// loops have to be valid, and finite to be unrolled for sidfx
+	io_total = 0;
+	for(char ch=0; ch<3; ch++)
+	{
+		char	n = voice_nrows(ch);
+		if (!n)
+			voices &= ~(1 << ch);
+		else if (voices & (1 << ch))
+		{
+			if (fx_check(voice_fx[ch], n) != 0xff)
+			{
+				io_refuse(S"export needs loops that can be played");
+				return;
+			}
+
+			unsigned	lines = n + 4;
+			if (!packed)
+			{
+				lines = io_unroll_rows(ch);
+				if (lines > 255)
+				{
+					io_refuse(S"loops need the packed export");
+					return;
+				}
+				lines += 3;
+			}
+			io_total += lines;
+		}
+	}
+	if (!voices)
+	{
+		io_refuse(S"no rows to export");
+		return;
+	}
+
+	strcpy(io_name, name);
+	strcpy(fname, "@0:");
+	strcat(fname, name);
+	strcat(fname, p".c" ",P,W");
+
+	io_begin();
+	krnio_setnam(fname);
+	bool ok = krnio_open(filenum, drive, filechannel) && krnio_chkout(filenum);
+	io_end();
+
+	if (!ok)
+	{
+		io_close();
+		io_refuse(S"could not write export");
+		return;
+	}
+
+	// after a save the rate covers both files
+	if (!io_job)
+	{
+		io_t0 = tod_tenths();
+		io_bytes = 0;
+	}
+
+	io_start(IOJ_EXPORT);
+	io_left = 0;
+	io_packed = packed;
+	io_voices = voices;
+	io_multi = (voices & (voices - 1)) != 0;
+	if (packed)
+		fx_pack();
+	io_export_next();
+}
+
+// Line io_row of the export into io_line
+void io_export_line(void)
+{
+	int		len;
+	char	head = io_packed ? 3 : 2;
+	char	suffix[3];
+
+	suffix[0] = io_multi ? '_' : 0;
+	suffix[1] = '1' + io_voice;
+	suffix[2] = 0;
+
+	// the cycles are those of all voices playing together
+	if (io_row == 0 && io_packed)
+	{
+		unsigned	size = pack_ofs[io_voice + 1] - pack_ofs[io_voice];
+		if (cost_valid && pack_ticks)
+			len = sprintf(io_line, "// %u bytes packed from %u, %u ticks, %u avg %u max cycles per sfxpack_loop tick\n",
+				size, (unsigned)(sizeof(SIDFX) * io_n), pack_ticks, (unsigned)(pack_sum / pack_ticks), pack_max);
+		else
+			len = sprintf(io_line, "// %u bytes packed from %u, cycles per tick not measured (F3 in osfxedit)\n",
+				size, (unsigned)(sizeof(SIDFX) * io_n));
+	}
+	else if (io_row == 0)
+	{
+		if (cost_valid && cost_ticks)
+			len = sprintf(io_line, "// %u bytes, %u ticks, %u avg %u max cycles per sidfx_loop_2 tick\n",
+				(unsigned)(sizeof(SIDFX) * io_out), cost_ticks, (unsigned)(cost_sum / cost_ticks), cost_max);
+		else
+			len = sprintf(io_line, "// %u bytes, cycles per tick not measured (F3 in osfxedit)\n", (unsigned)(sizeof(SIDFX) * io_out));
+	}
+	else if (io_row == 1 && io_packed)
+		len = sprintf(io_line, "static const char SFXP_%s%s[] = {\n", io_name, suffix);
+	else if (io_row == 1)
+		len = sprintf(io_line, "static const SIDFX SFX_%s%s[] = {\n", io_name, suffix);
+	else if (io_row == 2 && io_packed)
+		len = sprintf(io_line, "\t%u,\n", io_n);
+	else if (io_row < io_n + head && io_packed)
+	{
+		// one line of bytes per row
+		char n = sfxpack_rowsize(io_pack);
+		io_line[0] = '\t';
+		len = 1;
+		for(char i=0; i<n; i++)
+			len += sprintf(io_line + len, "0x%02x, ", io_pack[i]);
+		io_line[len - 1] = '\n';
+		io_pack += n;
+	}
+	else if (io_row < io_out + head)
+	{
+		const SIDFX& s(io_fxp[io_fx]);
+		io_fx = io_unroll(io_fx);
+		len = sprintf(
+		    io_line,
+		    "\t{%u, %u, 0x%02x, 0x%02x, 0x%02x, %d, %d, %d, %d, 0},\n",
+		    s.freq, s.pwm, s.ctrl, s.attdec, s.susrel, s.dfreq, s.dpwm,
+		    s.time1, s.time0);
+	}
+	else
+		len = sprintf(io_line, "};\n");
+
+	io_ptr = io_line;
+	io_left = len;
+	io_row++;
+}
+
+// End of a job that transferred all its bytes
+void io_done(void)
+{
+	io_close();
+
+	switch (io_job)
+	{
+	case IOJ_LOAD:
+		voice_loaded(io_vrows, max_neffects);
+		io_stop();
+		io_report(io_bytes, io_t0, false);
+		showfxs();
+		hires_draw_start();
+		cursorY = neffects;
+		break;
+	case IOJ_SAVE:
+		dir_add(io_name);
+		edit_export(io_name, io_packed, 7);
+		break;
+	default:
+		io_stop();
+		io_report(io_bytes, io_t0, false);
+		break;
+	}
+}
+
+// Move the bytes of the running job for one frame
+void io_step(void)
+{
+	unsigned t = cycles_now();
+
+	do
+	{
+		if (!io_left)
+		{
+			if (io_job == IOJ_EXPORT && (io_row < io_lines || io_export_next()))
+			{
+				io_export_line();
+				io_pos++;
+			}
+			else if (io_job == IOJ_SAVE && io_chunk < 3)
+			{
+				// the rows of the voices in the order of the voices
+				io_ptr = (char *)voice_fx[io_chunk];
+				io_left = sizeof(SIDFX) * voice_nrows(io_chunk);
+				io_chunk++;
+				continue;
+			}
+			else
+			{
+				io_done();
+				return;
+			}
+		}
+
+		if (io_job == IOJ_LOAD)
+			*io_ptr = io_getch();
+		else
+			io_putch(*io_ptr);
+		io_ptr++;
+		io_left--;
+		io_bytes++;
+		if (io_job != IOJ_EXPORT)
+			io_pos++;
+
+		char st = krnio_status();
+		if (st && !(io_job == IOJ_LOAD && st == KRNIO_EOF && !io_left))
+		{
+			// a short load keeps the rows that came in
+			if (io_job == IOJ_LOAD)
+			{
+				voice_loaded(io_vrows, (io_ptr - (char *)FxPool) / sizeof(SIDFX));
+				if (!fx_total())
+					edit_new();
+				showfxs();
+				hires_draw_start();
+				cursorY = neffects;
+			}
+
+			io_close();
+			io_stop();
+			if (st == KRNIO_EOF)
+				show_msg(S"file too short");
+			else
+			{
+				read_drive_status();
+				show_msg(drive_status, true);
+			}
+			return;
+		}
+
+	} while (t - cycles_now() < io_budget);
+
+	io_bar();
+}
+
+// Keys while a job runs, only space to play the effect when it is not
+// being loaded
+void io_key(char k)
+{
+	if (k == KSCAN_SPACE && io_job != IOJ_LOAD)
+	{
+		if (live_mode)
+			live_stop();
+		if (fx_play())
+			irq_cnt = 0;
+	}
+}
+
+void edit_load(void)
+{
+	char fname[24];
+
+	strcpy(fname, "@0:");
+	edit_filename(fname);
+
+	// bank/entry loads a set from a sound bank
+	char * sep = strchr(fname, '/');
+	if (sep)
+	{
+		*sep = 0;
+		bank_load(fname, sep + 1);
+		return;
+	}
+
+	io_begin();
+	unsigned t0 = tod_tenths();
+
+	if (fast_io && edit_load_fast(fname, t0))
+	{
+		io_end();
+		return;
+	}
+
+	strcat(fname, ",P,R");
+
+	// the header is read here, the rows by the job
+	krnio_setnam(fname);
+	if (krnio_open(filenum, drive, filechannel))
+	{
+
+		// Magic code and save file version
+		char v = krnio_getch(filenum);
+        auto status = krnio_status();
+		if (status == KRNIO_OK)
+		{
+			if (v <= 0xb3 || v == file_version)
+			{
+				char	head = 2;
+				io_vrows[0] = io_vrows[1] = 0;
+				if (v == file_version)
+				{
+					io_vrows[0] = krnio_getch(filenum);
+					io_vrows[1] = krnio_getch(filenum);
+					head = 4;
+				}
+				io_vrows[2] = krnio_getch(filenum);
+
+				unsigned	rows = io_vrows[0] + io_vrows[1] + io_vrows[2];
+				if (krnio_status() == KRNIO_OK && rows <= max_neffects && krnio_chkin(filenum))
+				{
+					io_end();
+
+					if (live_mode)
+						live_stop();
+					fx_stop();
+					cost_valid = false;
+					voice_clear();
+					view_top = 0;
+					showfxs();
+					hires_draw_start();
+
+					io_start(IOJ_LOAD);
+					io_t0 = t0;
+					io_bytes = head;
+					io_ptr = (char*)FxPool;
+					io_left = sizeof(SIDFX) * rows;
+					io_pos = head;
+					io_total = head + io_left;
+					if (!io_left)
+						io_done();
+					return;
+				}
+				show_msg(S"could not read from file");
+			}
+			else
+			{
+				show_msg(S"incorrect file version");
+			}
+		}
+		else if (status & KRNIO_EOF)
+        {
+			show_msg(S"could not read from file");
+		}
+		else
+		{
+			read_drive_status();
+			show_msg(drive_status, true);
+		}
+		krnio_close(filenum);
+	}
+	else
+	{
+		show_msg(S"drive does not exist");
+	}
+
+	io_end();
+}
+
+// Load from the filename field and show the effects, unless a bank list
+// came up instead or the job of a kernal load does it when done
+void edit_load_show(void)
+{
+	edit_load();
+	if (io_job)
+		return;
+	if (!list_mode)
+	{
+		showfxs();
+		hires_draw_start();
+	}
+	cursorY = neffects;
+}
+
+// Save to the filename field, packed writes the .c export as a packed
+// stream
+void edit_save(bool packed)
+{
+	char name[16], fname[24];
+
+	edit_filename(name);
+
+	char * sep = strchr(name, '/');
+	if (sep)
+	{
+		*sep = 0;
+		bank_save(name, sep + 1, packed);
+		return;
+	}
+
+	io_begin();
+	bool ok = false;
+	unsigned t0 = tod_tenths();
+
+	strcpy(fname, "@0:");
+	strcat(fname, name);
+	strcat(fname, ",P,W");
+
+	// the header is written here, the rows and the export by the jobs
+	krnio_setnam(fname);
+	if (krnio_open(filenum, drive, filechannel))
+	{
+		// Magic code and save file version
+		krnio_putch(2, file_version);
+		if (krnio_status() == KRNIO_OK)
+		{
+			for(char ch=0; ch<3; ch++)
+				krnio_putch(filenum, voice_nrows(ch));
+			ok = krnio_status() == KRNIO_OK && krnio_chkout(filenum);
+		}
+
+		if (ok)
+		{
+			io_end();
+
+			strcpy(io_name, name);
+			io_packed = packed;
+			io_start(IOJ_SAVE);
+			io_t0 = t0;
+			io_bytes = 4;
+			io_chunk = 0;
+			io_left = 0;
+			io_pos = 4;
+			io_total = 4 + sizeof(SIDFX) * fx_total();
+			return;
+		}
+
+		krnio_clrchn();
+		krnio_close(filenum);
+		read_drive_status();
+		show_msg(drive_status, true);
+	}
+	else
+	{
+		show_msg(S"drive does not exist");
+	}
+
+	io_end();
+}
+
+// Sound banks are relative files holding many effect sets. The first
+// records hold the index of names, first records and row counts, each set
+// takes records of 17 rows from its first record on. A set is read or
+// rewritten on its own by selecting its records with the P command, and
+// the index of the last bank is kept for loads from the same bank. A set
+// holds the rows of one voice, it is saved from and loaded into the voice
+// being edited.
+static const char bank_version = 0xb4;
+static const char bank_reclen = 17 * sizeof(SIDFX);
+static const char bank_idxrecs = 6;
+static const char bank_max = 89;
+
+struct BankEntry
+{
+	char		name[12];
+	char		rows, nrec;
+	unsigned	first;
+};
+
+// Exactly fills the index records
+struct BankIndex
+{
+	char		version, cnt;
+	unsigned	next;
+	BankEntry	entry[bank_max];
+};
+
+BankIndex	bank;
+char		bank_name[17];
+char		bank_drive;
+
+// Filename characters to screen codes
+void name_show(char * dp, const char * name)
+{
+	for(char i=0; name[i]; i++)
+	{
+		char ch = name[i];
+		if (ch >= p'a' && ch <= p'z')
+			ch += S'A' - p'a';
+		dp[i] = ch;
+	}
+}
+
+// Put a name into the filename field of the menu
+void menu_setname(const char * name)
+{
+	char * dp = Screen + (view_rows + 1) * 40;
+	for(char j=0; j<14; j++)
+		dp[21 + j] = S'.';
+
+	// the field holds 14 characters
+	char	fn[15];
+	char	n = 0;
+	while (n < 14 && name[n])
+	{
+		fn[n] = name[n];
+		n++;
+	}
+	fn[n] = 0;
+	name_show(dp + 21, fn);
+}
+
+// Select record rec of the bank file
+void bank_seek(unsigned rec)
+{
+	char cmd[5];
+	cmd[0] = 'P';
+	cmd[1] = 96 + filechannel;
+	cmd[2] = rec & 0xff;
+	cmd[3] = rec >> 8;
+	cmd[4] = 1;
+	krnio_write(15, cmd, 5);
+}
+
+// Read size bytes from record rec on, the drive does not send the zeros
+// at the end of a record so the buffer is cleared first
+bool bank_read(unsigned rec, char * dp, unsigned size)
+{
+	memset(dp, 0, size);
+	while (size)
+	{
+		char n = size < bank_reclen ? size : bank_reclen;
+		bank_seek(rec++);
+		krnio_read(filenum, dp, n);
+		if (krnio_status() & ~KRNIO_EOF)
+			return false;
+		dp += n;
+		size -= n;
+	}
+	return true;
+}
+
+// Write size bytes from record rec on, writing past the last record
+// extends the file
+bool bank_write(unsigned rec, const char * sp, unsigned size)
+{
+	while (size)
+	{
+		char n = size < bank_reclen ? size : bank_reclen;
+		bank_seek(rec++);
+		krnio_write(filenum, sp, n);
+		if (krnio_status() != KRNIO_OK)
+			return false;
+		sp += n;
+		size -= n;
+	}
+	return true;
+}
+
+// Open the bank with the command channel, create adds ",L" so a missing
+// file is made, returns false with the drive status shown
+bool bank_open(const char * name, bool create)
+{
+	char fname[24];
+	strcpy(fname, "0:");
+	strcat(fname, name);
+	if (create)
+	{
+		char * ep = fname + strlen(fname);
+		ep[0] = ','; ep[1] = 'L'; ep[2] = ',';
+		ep[3] = bank_reclen;
+		ep[4] = 0;
+	}
+
+	krnio_setnam("");
+	if (!krnio_open(15, drive, 15))
+	{
+		show_msg(S"drive does not exist");
+		return false;
+	}
+
+	krnio_setnam(fname);
+	krnio_open(filenum, drive, filechannel);
+	if (drive_error())
+	{
+		show_msg(drive_status, true);
+		krnio_close(filenum);
+		krnio_close(15);
+		return false;
+	}
+	return true;
+}
+
+void bank_close(void)
+{
+	krnio_close(filenum);
+	krnio_close(15);
+}
+
+// Read the index, a new file gets an empty one, false if it is no bank
+bool bank_read_index(const char * name)
+{
+	bank_name[0] = 0;
+
+	bank_seek(1);
+	if (drive_error() == 50)
+	{
+		// record not present
+		bank.version = bank_version;
+		bank.cnt = 0;
+		bank.next = bank_idxrecs + 1;
+	}
+	else if (!bank_read(1, (char *)&bank, sizeof(BankIndex)) || bank.version != bank_version)
+	{
+		show_msg(S"not a sound bank");
+		return false;
+	}
+
+	strcpy(bank_name, name);
+	bank_drive = drive;
+	return true;
+}
+
+// Entry names are zero padded to 12 characters
+bool bank_match(const char * name, const char * entry)
+{
+	char i = 0;
+	while (i < 12 && entry[i] && name[i] == entry[i])
+		i++;
+	return i == 12 || name[i] == entry[i];
+}
+
+// Index position of the named entry, bank.cnt if there is none
+char bank_find(const char * entry)
+{
+	char i = 0;
+	while (i < bank.cnt && !bank_match(bank.entry[i].name, entry))
+		i++;
+	return i;
+}
+
+void bank_paint(char i, char * dp)
+{
+	const BankEntry	&	e = bank.entry[i];
+
+	char name[13];
+	memcpy(name, e.name, 12);
+	name[12] = 0;
+
+	dp[0] = HexDigit[i >> 4];
+	dp[1] = HexDigit[i & 0x0f];
+	name_show(dp + 3, name);
+	dp[17] = HexDigit[e.rows >> 4];
+	dp[18] = HexDigit[e.rows & 0x0f];
+	memcpy(dp + 20, S"rows", 4);
+}
+
+void bank_load_entry(char i);
+
+// Load the picked entry of the listed bank by its index, the filename
+// field shows as much of bank/entry as fits
+void bank_pick(char i)
+{
+	char name[32];
+	strcpy(name, bank_name);
+	char n = strlen(name);
+	name[n++] = '/';
+	memcpy(name + n, bank.entry[i].name, 12);
+	name[n + 12] = 0;
+	menu_setname(name);
+
+	io_begin();
+	if (bank_open(bank_name, false))
+	{
+		bank_load_entry(i);
+		bank_close();
+	}
+	io_end();
+
+	showfxs();
+	hires_draw_start();
+	cursorY = neffects;
+	cursorX = 0;
+}
+
+// Read entry i of the index into the edited voice
+void bank_load_entry(char i)
+{
+	if (bank.entry[i].rows > fx_room())
+		show_msg(S"no room for it next to the other voices");
+	else if (bank_read(bank.entry[i].first, (char *)effects, sizeof(SIDFX) * bank.entry[i].rows))
+	{
+		cost_valid = false;
+		neffects = bank.entry[i].rows;
+		view_top = 0;
+	}
+	else
+	{
+		bank_name[0] = 0;
+		show_msg(S"could not read from bank");
+	}
+}
+
+// Load entry of the bank, an empty entry lists the bank instead
+void bank_load(const char * name, const char * entry)
+{
+	io_begin();
+
+	bool list = !entry[0];
+	if (bank_open(name, false))
+	{
+		// the index is read again for a listing, it may have changed
+		if (list || strcmp(bank_name, name) || bank_drive != drive)
+			bank_read_index(name);
+
+		if (bank_name[0] && !list)
+		{
+			char i = bank_find(entry);
+			if (i == bank.cnt)
+				show_msg(S"not in bank");
+			else
+				bank_load_entry(i);
+		}
+		bank_close();
+	}
+
+	io_end();
+
+	if (list && bank_name[0])
+	{
+		if (bank.cnt)
+		{
+			char title[40];
+			strcpy(title, S"bank ");
+			name_show(title + 5, name);
+			title[5 + strlen(name)] = 0;
+			list_open(title, bank.cnt, bank_paint, bank_pick);
+		}
+		else
+			show_msg(S"empty bank");
+	}
+}
+
+// Write the effects as entry of the bank, only the records of the entry
+// and of its index part are written
+void bank_save(const char * name, const char * entry, bool packed)
+{
+	if (!entry[0])
+	{
+		show_msg(S"no entry name");
+		return;
+	}
+
+	io_begin();
+
 	bool ok = false;
+	if (bank_open(name, true))
+	{
+		if (bank_read_index(name))
+		{
+			char i = bank_find(entry);
+			if (i == bank_max)
+				show_msg(S"bank full");
+			else
+			{
+				BankEntry	&	e = bank.entry[i];
+				unsigned		size = sizeof(SIDFX) * neffects;
+				char			nrec = (size + bank_reclen - 1) / bank_reclen;
+
+				if (i == bank.cnt)
+				{
+					memset(e.name, 0, 12);
+					for(char j=0; j<12 && entry[j]; j++)
+						e.name[j] = entry[j];
+					e.nrec = 0;
+					bank.cnt++;
+				}
+
+				// a grown set moves to the end of the file
+				if (nrec > e.nrec)
+				{
+					e.first = bank.next;
+					e.nrec = nrec;
+					bank.next += nrec;
+				}
+				e.rows = neffects;
+
+				// records of the header and of the entry
+				unsigned	eofs = (char *)&e - (char *)&bank;
+				char		r0 = eofs / bank_reclen, r1 = (eofs + sizeof(BankEntry) - 1) / bank_reclen;
+
+				ok = bank_write(e.first, (char *)effects, size) &&
+					 (r0 == 0 || bank_write(1, (char *)&bank, bank_reclen)) &&
+					 bank_write(1 + r0, (char *)&bank + r0 * bank_reclen, (r1 - r0 + 1) * bank_reclen);
+
+				if (!ok)
+				{
+					bank_name[0] = 0;
+					show_msg(S"could not write to bank");
+				}
+			}
+		}
+		bank_close();
+	}
+
+	if (ok)
+	{
+		char bname[16];
+		strcpy(bname, name);
+		strcat(bname, "/");
+		dir_add(bname);
+	}
+
+	io_end();
+
+	if (ok)
+		edit_export(entry, packed, 1 << voice);
+}
+
+// Directory cache, the effect files and banks of the disk in the drive,
+// read from "$" on the first use and after the drive number changed or
+// on request. Banks keep a / at the end to list them when picked.
+static const char dir_max = 144;
+
+char	dir_names[dir_max][16];
+char	dir_cnt;
+char	dir_drive;
+char	dir_title[17];
+
+void dir_add(const char * name)
+{
+	if (dir_drive != drive || dir_cnt == dir_max)
+		return;
+
+	for(char i=0; i<dir_cnt; i++)
+	{
+		if (!strcmp(dir_names[i], name))
+			return;
+	}
+	strcpy(dir_names[dir_cnt++], name);
+}
+
+// Take name and type from a line of the listing, the first one holds the
+// disk name. Only names that fit the filename field are kept, the .c
+// exports are left out.
+void dir_line(const char * line, bool head)
+{
+	const char * lp = strchr(line, '"');
+	if (!lp)
+		return;
+	lp++;
+
+	char name[17];
+	char n = 0;
+	bool fits = true;
+	while (*lp && *lp != '"' && n < 16)
+	{
+		char ch = *lp++;
+		if (!(ch >= p'a' && ch <= p'z' || ch >= '0' && ch <= '9' || ch == '-'))
+			fits = false;
+		name[n++] = ch;
+	}
+	name[n] = 0;
+
+	if (head)
+	{
+		strcpy(dir_title, name);
+		return;
+	}
+
+	if (*lp == '"')
+		lp++;
+	while (*lp == ' ' || *lp == '*')
+		lp++;
+
+	if (lp[0] == 'R' && lp[1] == 'E' && lp[2] == 'L')
+	{
+		if (fits && n < 14)
+		{
+			name[n] = '/';
+			name[n + 1] = 0;
+			dir_add(name);
+		}
+	}
+	else if (lp[0] == 'P' && lp[1] == 'R' && lp[2] == 'G')
+	{
+		if (n >= 2 && name[n - 2] == '.' && name[n - 1] == p'c')
+			;
+		else if (fits && n <= 14)
+			dir_add(name);
+	}
+}
 
-	char fname[24];
+// Read the listing, it comes as a basic program of link, block count and
+// text per line
+void dir_read(void)
+{
+	io_begin();
 
-	strcpy(fname, "@0:");
-	edit_filename(fname);
-	strcat(fname, ",P,R");
+	dir_cnt = 0;
+	dir_title[0] = 0;
+	dir_drive = drive;
 
-	krnio_setnam(fname);
-	if (krnio_open(filenum, drive, filechannel))
+	krnio_setnam("$");
+	if (krnio_open(filenum, drive, 0) && krnio_chkin(filenum))
 	{
+		char line[40];
+		bool head = true;
 
-		// Magic code and save file version
-		char v = krnio_getch(filenum);
-        auto status = krnio_status();
-		if (status == KRNIO_OK)
+		// load address
+		krnio_chrin();
+		krnio_chrin();
+
+		while (krnio_status() == KRNIO_OK)
 		{
-			if (v <= 0xb3)
+			char l0 = krnio_chrin();
+			char l1 = krnio_chrin();
+			if (!(l0 | l1))
+				break;
+			krnio_chrin();
+			krnio_chrin();
+
+			char n = 0;
+			for(;;)
 			{
-				neffects = krnio_getch(filenum);
-				krnio_read(filenum, (char*)effects, sizeof(SIDFX) * neffects);
-				ok = true;
-			}
-			else
-			{
-				show_msg(S"incorrect file version");
+				char ch = krnio_chrin();
+				if (!ch)
+					break;
+				if (n < 39)
+					line[n++] = ch;
+				if (krnio_status() != KRNIO_OK)
+					break;
 			}
+			line[n] = 0;
+
+			dir_line(line, head);
+			head = false;
 		}
-		else if (status & KRNIO_EOF)
-        {
-			show_msg(S"could not read from file");
-		}
-		else
-		{
-			read_drive_status();
-			show_msg(drive_status, true);
-		}
-		krnio_close(filenum);
+		krnio_clrchn();
+	}
+	krnio_close(filenum);
+
+	if (!dir_title[0])
+	{
+		// nothing came, the drive is missing or has no disk
+		dir_drive = 0;
+		read_drive_status();
+		show_msg(drive_status, true);
+	}
+
+	io_end();
+}
+
+void dir_paint(char i, char * dp)
+{
+	name_show(dp + 1, dir_names[i]);
+	if (strchr(dir_names[i], '/'))
+		memcpy(dp + 18, S"bank", 4);
+}
+
+// Picking loads the file or lists the bank
+void dir_pick(char i)
+{
+	menu_setname(dir_names[i]);
+	edit_load_show();
+	cursorX = 0;
+}
+
+// Show the directory for picking a file, from the cache unless it is for
+// another drive or refresh is asked for
+void dir_show(bool refresh)
+{
+	if (refresh || dir_drive != drive)
+		dir_read();
+	if (!dir_drive)
+		return;
+
+	if (dir_cnt)
+	{
+		char title[40];
+		strcpy(title, S"dir d09 ");
+		title[5] = '0' + drive / 10;
+		title[6] = '0' + drive % 10;
+		name_show(title + 8, dir_title);
+		title[8 + strlen(dir_title)] = 0;
+		list_open(title, dir_cnt, dir_paint, dir_pick);
 	}
 	else
+		show_msg(S"no effect files");
+}
+
+void cost_report(void)
+{
+	char	msg[48];
+	if (cost_ticks)
+		sprintf(msg, "%uT SIDFX %u/%u %uB PACK %u/%u %uB", cost_ticks,
+			(unsigned)(cost_sum / cost_ticks), cost_max, (unsigned)(sizeof(SIDFX) * fx_total()),
+			(unsigned)(pack_sum / pack_ticks), pack_max, pack_size);
+	else
+		sprintf(msg, "%uT LOOPED, PACK %u/%u CYC %uB", pack_ticks,
+			(unsigned)(pack_sum / pack_ticks), pack_max, pack_size);
+	msg[39] = 0;
+	show_msg(msg, true);
+	cost_valid = true;
+}
+
+// Optimiser, merges a row into the row before it when the VirtualSID
+// model writes the same registers in every tick either way. The effect is
+// timed with the cost run before and after to report the cycles saved.
+static const unsigned opt_max_ticks = 2048;
+
+char		opt_state;		// 1 timing the rows before, 2 after merging
+char		opt_rows;
+unsigned	opt_avg, opt_max;
+SIDFX		opt_fx[4];
+
+// Play both lists and compare the registers after every tick until both
+// are idle
+bool opt_same(const SIDFX * a, char na, const SIDFX * b, char nb)
+{
+	VirtualSID	va, vb;
+	vsid_reset(va);
+	vsid_reset(vb);
+
+	for(unsigned t=0; t<opt_max_ticks; t++)
 	{
-		show_msg(S"drive does not exist");
+		vsid_tick(va, a, na);
+		vsid_tick(vb, b, nb);
+		if (va.freq != vb.freq || va.pwm != vb.pwm || va.ctrl != vb.ctrl ||
+			va.attdec != vb.attdec || va.susrel != vb.susrel || va.phase != vb.phase ||
+			(va.state == SIDFX_IDLE) != (vb.state == SIDFX_IDLE))
+			return false;
+		if (va.state == SIDFX_IDLE)
+			return true;
 	}
+	return false;
+}
 
-#ifdef OSFXEDIT_USE_NMI
-	cia2.icr = 0b10000001; // enable NMI
-#endif
-	spr_show(0, true);
-	spr_show(1, true);
-	spr_show(2, true);
-	vic.intr_enable = 1;
-	rirq_start();
+// Slope that takes from over len ticks to to, false if there is none
+bool opt_slope(vsid_u16 from, vsid_u16 to, char len, int & d)
+{
+	if ((vsid_u16)(from + len * d) == to)
+		return true;
+	int	diff = to - from;
+	d = diff / (int)len;
+	return d * (int)len == diff;
 }
 
-void edit_save(void)
+// Merge row i + 1 into row i if the rows around them play the same
+bool opt_row(char i)
 {
-	rirq_stop();
-	vic.intr_enable = 0;
-	spr_show(0, false);
-	spr_show(1, false);
-	spr_show(2, false);
+	const SIDFX	&	a = effects[i];
+	const SIDFX	&	b = effects[i + 1];
 
-#ifdef OSFXEDIT_USE_NMI
-	cia2.icr = 0b00000001; // disable NMI
-#endif
+	if (a.ctrl != b.ctrl || a.attdec != b.attdec || a.susrel != b.susrel)
+		return false;
 
-	bool ok = false;
+	// a gated row has to go on without releasing
+	SIDFX		m = a;
+	char		len;
+	if (a.ctrl & SID_CTRL_GATE)
+	{
+		if (a.time0 || a.time1 + b.time1 > 255)
+			return false;
+		len = a.time1;
+		m.time1 = a.time1 + b.time1;
+		m.time0 = b.time0;
+	}
+	else
+	{
+		if (a.time0 + b.time0 > 255)
+			return false;
+		len = a.time0;
+		m.time0 = a.time0 + b.time0;
+	}
 
-	char fname[24];
+	if (!len || !opt_slope(a.freq, b.freq, len, m.dfreq) || !opt_slope(a.pwm, b.pwm, len, m.dpwm))
+		return false;
 
-	strcpy(fname, "@0:");
-	edit_filename(fname + 3);
-	strcat(fname, ",P,W");
+	// the row before and after cover the changes from and to them
+	char	lo = i ? i - 1 : 0;
+	char	hi = i + 3 < neffects ? i + 3 : neffects;
+	char	n = 0;
+	for(char j=lo; j<hi; j++)
+	{
+		if (j == i)
+			opt_fx[n++] = m;
+		else if (j != i + 1)
+			opt_fx[n++] = effects[j];
+	}
 
-	krnio_setnam(fname);
-	if (krnio_open(filenum, drive, filechannel))
+	if (!opt_same(effects + lo, hi - lo, opt_fx, n))
+		return false;
+
+	effects[i] = m;
+	neffects--;
+	memmove(effects + i + 1, effects + i + 2, sizeof(SIDFX) * (neffects - i - 1));
+	return true;
+}
+
+// Time the rows as they are, opt_merge follows when the run is complete
+void opt_start(void)
+{
+	if (fx_any_loop())
 	{
-		// Magic code and save file version
-		krnio_putch(2, 0xb3);
-		if (krnio_status() == KRNIO_OK)
-		{
-			krnio_putch(filenum, neffects);
-			krnio_write(filenum, (char*)effects, sizeof(SIDFX) * neffects);
-			if (krnio_status() == KRNIO_OK) ok = true;
-		}
+		show_msg(S"optimise needs effects without loops");
+		return;
+	}
+	opt_rows = neffects;
+	opt_state = 1;
+	cost_start();
+}
 
-		krnio_close(filenum);
-		if (ok)
-		{
-			strcpy(fname, "@0:");
-			edit_filename(fname + 3);
-                        strcat(fname, p".c" ",P,W");
+// Merge all rows that can be, then time the result
+void opt_merge(void)
+{
+	opt_avg = cost_sum / cost_ticks;
+	opt_max = cost_max;
+
+	char i = 0;
+	while (i + 1 < neffects)
+	{
+		if (!opt_row(i))
+			i++;
+	}
 
-			krnio_setnam(fname);
-			krnio_open(filenum, drive, filechannel);
-			edit_filename(fname);
+	if (neffects == opt_rows)
+	{
+		opt_state = 0;
+		cost_valid = true;
+		show_msg(S"no rows to merge");
+		return;
+	}
 
-			char buffer[200];
-			int  len = sprintf(buffer, "static const SIDFX SFX_%s[] = {\n", fname);
-			krnio_write(filenum, buffer, len);
-			if (krnio_status() == KRNIO_OK) {
+	if (view_top >= neffects)
+		view_top = 0;
+	if (cursorY < max_neffects && cursorY > neffects)
+		cursorY = neffects;
+	showfxs();
+	hires_draw_start();
 
-				for (char i = 0; i < neffects; i++)
-				{
-					const SIDFX& s(effects[i]);
-					len = sprintf(
-					    buffer,
-					    "\t{%u, %u, 0x%02x, 0x%02x, 0x%02x, %d, %d, %d, %d, 0},\n",
-					    s.freq, s.pwm, s.ctrl, s.attdec, s.susrel, s.dfreq, s.dpwm,
-					    s.time1, s.time0);
-					krnio_write(filenum, buffer, len);
-				}
-				len = sprintf(buffer, "};\n");
-				krnio_write(filenum, buffer, len);
-			}
-			else
-			{
-				read_drive_status();
-				show_msg(drive_status, true);
-			}
-			krnio_close(filenum);
+	opt_state = 2;
+	cost_start();
+}
+
+void opt_report(void)
+{
+	char	msg[48];
+	opt_state = 0;
+	sprintf(msg, "-%u ROWS -%uB AVG %u>%u MAX %u>%u", opt_rows - neffects,
+		(unsigned)(sizeof(SIDFX) * (opt_rows - neffects)), opt_avg, (unsigned)(cost_sum / cost_ticks), opt_max, cost_max);
+	msg[39] = 0;
+	show_msg(msg, true);
+	cost_valid = true;
+}
+
+// The stress test covers the effect lines with its histogram, the counts
+// in the head line and the settings and cycles in the menu line
+static const char StressHead[] = S"STRESS 00000 TICKS 00000 MISSED         ";
+static const char StressRow[]  = S"EVERY 000+000 TICKS AVG 00000 MAX 00000 ";
+
+// Three digits of u at dp
+void stress_digits(unsigned u, char * dp)
+{
+	char	d[5];
+	uto5digit(u, d);
+	dp[0] = d[2];
+	dp[1] = d[3];
+	dp[2] = d[4];
+}
+
+void stress_show(void)
+{
+	char	*	dp = Screen;
+	char	*	cp = Color;
+
+	for(char i=0; i<40; i++)
+	{
+		dp[i] = StressHead[i];
+		cp[i] = VCOL_WHITE;
+	}
+	uto5digit(stress_ticks, dp + 7);
+	uto5digit(stress_miss, dp + 19);
+	showtick_at(dp);
+
+	unsigned	peak = 1;
+	for(char r=0; r<stress_buckets; r++)
+	{
+		if (stress_hist[r] > peak)
+			peak = stress_hist[r];
+	}
+
+	for(char r=0; r<stress_buckets; r++)
+	{
+		dp += 40;
+		cp += 40;
+
+		unsigned	lo = (unsigned)r << stress_shift;
+		uto5digit(lo, dp);
+		if (r + 1 < stress_buckets)
+		{
+			dp[5] = S'-';
+			uto5digit(lo + (1 << stress_shift) - 1, dp + 6);
 		}
 		else
 		{
-			read_drive_status();
-			show_msg(drive_status, true);
+			dp[5] = S'+';
+			for(char i=6; i<11; i++)
+				dp[i] = S' ';
+		}
+		dp[11] = S' ';
+		uto5digit(stress_hist[r], dp + 12);
+		dp[17] = S' ';
+
+		char	w = (unsigned long)stress_hist[r] * 22 / peak;
+		for(char i=0; i<22; i++)
+		{
+			dp[18 + i] = i < w ? S' ' | 0x80 : S' ';
+			cp[18 + i] = VCOL_YELLOW;
 		}
+		for(char i=0; i<18; i++)
+			cp[i] = VCOL_LT_BLUE;
 	}
-	else
+
+	dp = Screen + (view_rows + 1) * 40;
+	cp = Color + (view_rows + 1) * 40;
+	for(char i=0; i<40; i++)
 	{
-		show_msg(S"drive does not exist");
+		dp[i] = StressRow[i];
+		cp[i] = VCOL_GREEN;
+	}
+	stress_digits(stress_every, dp + 6);
+	stress_digits(stress_rnd, dp + 10);
+	for(char i=0; i<3; i++)
+		cp[(stress_sel ? 10 : 6) + i] = VCOL_WHITE;
+	if (stress_ticks)
+	{
+		uto5digit(stress_sum / stress_ticks, dp + 24);
+		uto5digit(stress_max, dp + 34);
 	}
+}
 
-#ifdef OSFXEDIT_USE_NMI
-	cia2.icr = 0b10000001; // enable NMI
-#endif
-	spr_show(0, true);
-	spr_show(1, true);
-	spr_show(2, true);
-	vic.intr_enable = 1;
-	rirq_start();
+void stress_start(void)
+{
+	bool	loops = fx_any_loop();
+	if (loops)
+	{
+		if (!fx_valid())
+			return;
+		fx_pack();
+	}
+	for(char ch=0; ch<3; ch++)
+		stress_packed[ch] = loops && fx_has_loop(voice_fx[ch], voice_nrows(ch));
+
+	cost_run = false;
+	cost_pack = false;
+	cost_done = false;
+	valid_run = false;
+	valid_done = false;
+	opt_state = 0;
+
+	// the menu line goes back to the menu when the test ends
+	if (prof_show)
+		prof_toggle_off();
+	if (msg_cnt)
+	{
+		msg_cnt = 0;
+		restore_menu();
+	}
+	save_menu();
+
+	stress_frames = 0;
+	stress_reset = true;
+	stress_run = true;
+	stress_show();
+}
+
+void stress_stop(void)
+{
+	stress_run = false;
+	fx_stop();
+	showfxs();
+	restore_menu();
+}
+
+// + and - change the interval or the random offset, the cursor keys pick
+// one of them. A change or return starts counting again.
+void stress_key(char k, char n)
+{
+	char	*	vp = stress_sel ? &stress_rnd : &stress_every;
+	char		lo = stress_sel ? 0 : 1;
+
+	switch (k)
+	{
+	case KSCAN_PLUS:
+	case KSCAN_DOT:
+	case KSCAN_EQUAL:
+		*vp = 255 - *vp < n ? 255 : *vp + n;
+		stress_reset = true;
+		break;
+	case KSCAN_MINUS:
+	case KSCAN_COMMA:
+		*vp = *vp - lo < n ? lo : *vp - n;
+		stress_reset = true;
+		break;
+	case KSCAN_CSR_RIGHT:
+	case KSCAN_CSR_RIGHT | KSCAN_QUAL_SHIFT:
+		stress_sel ^= 1;
+		break;
+	case KSCAN_RETURN:
+		stress_reset = true;
+		break;
+	case KSCAN_SPACE:
+	case KSCAN_F7 | KSCAN_QUAL_SHIFT:
+		stress_stop();
+		return;
+	}
+
+	stress_show();
+}
+
+static const char ProfRow[]  = S"       MIN 00000 AVG 00000 MAX 00000    ";
+static const char ProfName[] = S"KEYB SFX  HIRESROW  MARK ";
+
+// Show the stats of the selected slot in the menu line and start the next
+// measuring period
+void prof_update(void)
+{
+	char * dp = Screen + (view_rows + 1) * 40;
+	char * cp = Color + (view_rows + 1) * 40;
+
+	const ProfStat	&	p = prof_stats[prof_show - 1];
+
+	for(char i=0; i<40; i++)
+	{
+		dp[i] = ProfRow[i];
+		cp[i] = VCOL_GREEN;
+	}
+	for(char i=0; i<5; i++)
+		dp[i] = ProfName[5 * (prof_show - 1) + i];
+
+	if (p.cnt)
+	{
+		uto5digit(p.min, dp + 11);
+		uto5digit(p.sum / p.cnt, dp + 21);
+		uto5digit(p.max, dp + 31);
+	}
+
+	prof_reset();
+}
+
+char prof_menu[40];
+
+void prof_toggle_off(void)
+{
+	char * dp = Screen + (view_rows + 1) * 40;
+	char * cp = Color + (view_rows + 1) * 40;
+	for (char i = 0; i < 40; i++)
+	{
+		dp[i] = prof_menu[i];
+		cp[i] = VCOL_LT_BLUE;
+	}
+	prof_show = 0;
+}
+
+// Cycle the profiler line through the slots and back to the menu
+void prof_toggle(void)
+{
+	if (prof_show == 0)
+		memcpy(prof_menu, Screen + (view_rows + 1) * 40, 40);
+
+	prof_reset();
+	prof_show++;
+	if (prof_show > PROF_NUM)
+		prof_toggle_off();
+	else
+		prof_update();
 }
 
 void edit_new(void)
 {
+	cost_valid = false;
+	voice_clear();
 	neffects = 1;
 	effects[0] = basefx;
+	view_top = 0;
 }
 
-char * menup = Screen + (max_neffects + 1) * 40;
+char * menup = Screen + (view_rows + 1) * 40;
 
 void edit_menu(char k)
 {
@@ -597,7 +3747,7 @@ void edit_menu(char k)
 		if (neffects < max_neffects)
 			cursorY = neffects;
 		else
-			cursorY = 9;
+			cursorY = neffects - 1;
 		break;
 	case KSCAN_CSR_RIGHT:
 		if (cursorX < 15)
@@ -619,13 +3769,10 @@ void edit_menu(char k)
 		switch (cursorX)
 		{
 		case 0:
-			edit_load();
-			showfxs();
-			hires_draw_start();
-                        cursorY = neffects;
+			edit_load_show();
 			break;
 		case 5:
-			edit_save();
+			edit_save(false);
                         cursorY = neffects;
 			cursorX = 0;
 			break;
@@ -636,17 +3783,37 @@ void edit_menu(char k)
                         cursorY = neffects;
 			cursorX = 0;
 			break;
+		case 15:
+			fast_io = !fast_io;
+			showdrive();
+			break;
 		default:
+			if (cursorX >= 21)
+				dir_show(false);
 			cursorX = 0;
 			break;
 		}
 		break;
+	case KSCAN_RETURN | KSCAN_QUAL_SHIFT:
+		if (cursorX == 5)
+		{
+			edit_save(true);
+			cursorY = neffects;
+			cursorX = 0;
+		}
+		else if (cursorX >= 21)
+		{
+			dir_show(true);
+			cursorX = 0;
+		}
+		break;
 	case KSCAN_PLUS:
 	case KSCAN_DOT:
 	case KSCAN_EQUAL:
         if (cursorX == 15 && drive < 11)
         {
           drive++;
+          dir_drive = 0;
           showdrive();
         }
 		break;
@@ -655,6 +3822,7 @@ void edit_menu(char k)
         if (cursorX == 15 && drive > 8)
         {
           drive--;
+          dir_drive = 0;
           showdrive();
         }
 		break;
@@ -675,40 +3843,259 @@ void edit_menu(char k)
 		if (cursorX >= 21)
 		{
 			char ch = keyb_codes[k];
-			if (ch >= '0' && ch <= '9' || ch >= 'a' && ch <= 'z' || ch >= 'A' && ch <= 'Z' || ch == '-')
+			if (ch >= '0' && ch <= '9' || ch >= 'a' && ch <= 'z' || ch >= 'A' && ch <= 'Z' || ch == '-' || ch == '/')
 			{
 				if (ch >= 'a' && ch <= 'z')
 					ch -= 'a' - S'A';
 				else if (ch >= 'A' && ch <= 'Z')
 					ch -= 'A' - S'A';
 
-				for(char i=33; i>=cursorX; i--)
-					menup[i + 1] = menup[i];
-				menup[cursorX] = ch;
-				if (cursorX < 38)
-					cursorX++;
-			}
+				for(char i=33; i>=cursorX; i--)
+					menup[i + 1] = menup[i];
+				menup[cursorX] = ch;
+				if (cursorX < 38)
+					cursorX++;
+			}
+		}
+		break;
+	}
+}
+
+// Keys that work anywhere, returns true if the key was used
+bool edit_global(char k)
+{
+	switch (k)
+	{
+	case KSCAN_F1:
+		if (live_mode)
+			live_stop();
+		else
+			live_start(cursorY < neffects ? cursorY : 0);
+		return true;
+	case KSCAN_F1 | KSCAN_QUAL_SHIFT:
+		prof_toggle();
+		return true;
+	case KSCAN_F3:
+		if (live_mode)
+			live_stop();
+		opt_state = 0;
+		cost_start();
+		return true;
+	case KSCAN_F3 | KSCAN_QUAL_SHIFT:
+		if (live_mode)
+			live_stop();
+		// ENV3 and OSC3 are drawn over the preview of the edited voice
+		if (voice != 2)
+			show_msg(S"envelope validation needs voice 3");
+		else
+			valid_start();
+		return true;
+	case KSCAN_F7:
+		if (live_mode)
+			live_stop();
+		opt_start();
+		return true;
+	case KSCAN_F7 | KSCAN_QUAL_SHIFT:
+		if (live_mode)
+			live_stop();
+		stress_start();
+		return true;
+	case KSCAN_F5:
+		vsid_accurate = !vsid_accurate;
+		show_msg(vsid_accurate ? S"accurate envelope" : S"fast envelope");
+		hires_draw_start();
+		return true;
+	case KSCAN_F5 | KSCAN_QUAL_SHIFT:
+		// the profiler line covers the rate shown in the menu
+		if (prof_show)
+			prof_toggle_off();
+		tick_set(!tick_nmi);
+		showtick();
+		hires_draw_start();
+		return true;
+	}
+
+	return false;
+}
+
+// Keep the loop rows below row n on their first row after a row was
+// inserted or deleted there
+void loop_shift(char n, bool insert)
+{
+	for(char i=n; i<neffects; i++)
+	{
+		SIDFX	&	l = effects[i];
+		if (vsid_isloop(l) && l.freq > n)
+		{
+			if (insert)
+				l.freq++;
+			else
+				l.freq--;
+			showfxs_fields(i, FXD_FREQ);
+		}
+	}
+}
+
+// Insert a copy of the row under the cursor, or a new row on '#'
+void edit_insert(void)
+{
+	if (neffects < fx_room())
+	{
+		if (cursorY == neffects)
+		{
+			effects[neffects] = basefx;
+			neffects++;
+			showfxs_row(cursorY);
 		}
-		break;
+		else
+		{
+			memmove(effects + cursorY + 1, effects + cursorY, sizeof(SIDFX) * (neffects - cursorY));
+			neffects++;
+			showfxs_insert(cursorY);
+			loop_shift(cursorY, true);
+		}
+		hires_draw_from(cursorY);
+	}
+}
+
+// Delete the row under the cursor
+void edit_delete(void)
+{
+	// a voice can be emptied as long as another one has rows
+	if (cursorY < neffects && (neffects > 1 || neffects < fx_total()))
+	{
+		neffects--;
+		memmove(effects + cursorY, effects + cursorY + 1, sizeof(SIDFX) * (neffects - cursorY));
+		showfxs_delete(cursorY);
+		loop_shift(cursorY, false);
+		hires_draw_from(cursorY);
+	}
+}
+
+// One + step of the field under the cursor
+void edit_inc(SIDFX & s)
+{
+	// loop rows step their first row, only T1 is edited as usual
+	if (vsid_isloop(s) && BcdField[cursorX] != BCD_TIME1)
+	{
+		if (BcdField[cursorX] == BCD_FREQ && s.freq + 1 < cursorY)
+			s.freq++;
+		return;
+	}
+
+	switch (cursorX)
+	{
+	case 2: s.ctrl |= SID_CTRL_TRI; s.ctrl &= ~SID_CTRL_NOISE; break;
+	case 3: s.ctrl |= SID_CTRL_SAW; s.ctrl &= ~SID_CTRL_NOISE;break;
+	case 4: s.ctrl |= SID_CTRL_RECT; s.ctrl &= ~SID_CTRL_NOISE;break;
+	case 5: s.ctrl |= SID_CTRL_NOISE; s.ctrl &= ~(SID_CTRL_TRI | SID_CTRL_SAW | SID_CTRL_RECT); break;
+	case 6: s.ctrl |= SID_CTRL_GATE; break;
+
+	case  8: if (s.freq < 55536) s.freq += 10000; break;
+	case  9: if (s.freq < 64536) s.freq +=  1000; break;
+	case 10: if (s.freq < 65436) s.freq +=   100; break;
+	case 11: if (s.freq < 65526) s.freq +=    10; break;
+	case 12: if (s.freq < 65535) s.freq +=     1; break;
+
+	case 14: if (s.pwm < 3096) s.pwm +=  1000; break;
+	case 15: if (s.pwm < 3996) s.pwm +=   100; break;
+	case 16: if (s.pwm < 4086) s.pwm +=    10; break;
+	case 17: if (s.pwm < 4085) s.pwm +=     1; break;
+
+	case 19: if ((s.attdec & 0xf0) < 0xf0) s.attdec += 0x10; break;
+	case 20: if ((s.attdec & 0x0f) < 0x0f) s.attdec += 0x01; break;
+	case 21: if ((s.susrel & 0xf0) < 0xf0) s.susrel += 0x10; break;
+	case 22: if ((s.susrel & 0x0f) < 0x0f) s.susrel += 0x01; break;
+
+	case 24: if (s.dfreq < 22768) s.dfreq += 10000; break;
+	case 25: if (s.dfreq < 31768) s.dfreq +=  1000; break;
+	case 26: if (s.dfreq < 32668) s.dfreq +=   100; break;
+	case 27: if (s.dfreq < 32758) s.dfreq +=    10; break;
+	case 28: if (s.dfreq < 32767) s.dfreq +=     1; break;
+
+	case 30: if (s.dpwm < 3096) s.dpwm +=  1000; break;
+	case 31: if (s.dpwm < 3996) s.dpwm +=   100; break;
+	case 32: if (s.dpwm < 4086) s.dpwm +=    10; break;
+	case 33: if (s.dpwm < 4095) s.dpwm +=     1; break;
+
+	case 35: if (s.time1 < 90) s.time1 += 10; break;
+	case 36: if (s.time1 < 99) s.time1 +=  1; break;
+	case 38: if (s.time0 < 90) s.time0 += 10; break;
+	case 39: if (s.time0 < 99) s.time0 +=  1; break;
+	}
+}
+
+// One - step of the field under the cursor
+void edit_dec(SIDFX & s)
+{
+	if (vsid_isloop(s) && BcdField[cursorX] != BCD_TIME1)
+	{
+		if (BcdField[cursorX] == BCD_FREQ && s.freq > 0)
+			s.freq--;
+		return;
+	}
+
+	switch (cursorX)
+	{
+	case 2: s.ctrl &= ~SID_CTRL_TRI; break;
+	case 3: s.ctrl &= ~SID_CTRL_SAW; break;
+	case 4: s.ctrl &= ~SID_CTRL_RECT; break;
+	case 5: s.ctrl &= ~SID_CTRL_NOISE; break;
+	case 6: s.ctrl &= ~SID_CTRL_GATE; break;
+
+	case  8: if (s.freq >= 10000) s.freq -= 10000; break;
+	case  9: if (s.freq >=  1000) s.freq -=  1000; break;
+	case 10: if (s.freq >=   100) s.freq -=   100; break;
+	case 11: if (s.freq >=    10) s.freq -=    10; break;
+	case 12: if (s.freq >=     1) s.freq -=     1; break;
+
+	case 14: if (s.pwm >=  1000) s.pwm -=  1000; break;
+	case 15: if (s.pwm >=   100) s.pwm -=   100; break;
+	case 16: if (s.pwm >=    10) s.pwm -=    10; break;
+	case 17: if (s.pwm >=     1) s.pwm -=     1; break;
+
+	case 19: if ((s.attdec & 0xf0) > 0x00) s.attdec -= 0x10; break;
+	case 20: if ((s.attdec & 0x0f) > 0x00) s.attdec -= 0x01; break;
+	case 21: if ((s.susrel & 0xf0) > 0x00) s.susrel -= 0x10; break;
+	case 22: if ((s.susrel & 0x0f) > 0x00) s.susrel -= 0x01; break;
+
+	case 24: if (s.dfreq > -22768) s.dfreq -= 10000; break;
+	case 25: if (s.dfreq > -31768) s.dfreq -=  1000; break;
+	case 26: if (s.dfreq > -32668) s.dfreq -=   100; break;
+	case 27: if (s.dfreq > -32758) s.dfreq -=    10; break;
+	case 28: if (s.dfreq > -32767) s.dfreq -=     1; break;
+
+	case 30: if (s.dpwm > -3096) s.dpwm -=  1000; break;
+	case 31: if (s.dpwm > -3996) s.dpwm -=   100; break;
+	case 32: if (s.dpwm > -4086) s.dpwm -=    10; break;
+	case 33: if (s.dpwm > -4095) s.dpwm -=     1; break;
+
+	case 35: if (s.time1 >= 10) s.time1 -= 10; break;
+	case 36: if (s.time1 >   0) s.time1 -=  1; break;
+	case 38: if (s.time0 >= 10) s.time0 -= 10; break;
+	case 39: if (s.time0 >   0) s.time0 -=  1; break;
 	}
 }
 
-void edit_effects(char k)
+// Apply key k, + and - are applied n times as one batched change
+void edit_effects(char k, char n)
 {
 	bool	restart = false;
 	bool	redraw = false;
-	bool	redraw_all = false;
 
 	SIDFX	&	s = effects[cursorY];
+	SIDFX		before = s;
 
 	switch (k)
 	{
 	case KSCAN_RETURN:
 		cursorX = 0;
-		if (cursorY < 9)
+		if (cursorY < neffects)
 			cursorY++;
 		break;
 	case KSCAN_SPACE:
+		if (live_mode)
+			live_stop();
 		restart = true;
 		break;
 	case KSCAN_CSR_DOWN:
@@ -732,121 +4119,48 @@ void edit_effects(char k)
 	case KSCAN_HOME:
 		cursorX = 0;
 		break;
+	case KSCAN_V:
+		voice_select(voice == 2 ? 0 : voice + 1);
+		break;
+	case KSCAN_L:
+		// turn the row into a loop over the row above it, or back
+		if (cursorY > 0 && cursorY < neffects)
+		{
+			if (vsid_isloop(s))
+				s = basefx;
+			else
+			{
+				memset(&s, 0, sizeof(SIDFX));
+				s.ctrl = SID_CTRL_TEST;
+				s.freq = cursorY - 1;
+				s.time1 = 2;
+			}
+			showfxs_row(cursorY);
+			restart = true;
+			redraw = true;
+		}
+		break;
 	case KSCAN_PLUS:
 	case KSCAN_DOT:
 	case KSCAN_EQUAL:
-		switch (cursorX)
+		if (cursorX == 0)
+			edit_insert();
+		else
 		{
-		case 0:
-			 if (neffects < max_neffects)
-			 {
-			 	if (cursorY == neffects)
-			 		effects[neffects] = basefx;
-			 	else
-			 	{
-                                        for(char i=neffects; i>cursorY; i--) {
-				 		effects[i] = effects[i - 1];
-                                        }
-                                        redraw_all = true;
-			 	}
-
-			 	neffects++; 
-			 } 
-			 break;
-
-		case 2: s.ctrl |= SID_CTRL_TRI; s.ctrl &= ~SID_CTRL_NOISE; break;
-		case 3: s.ctrl |= SID_CTRL_SAW; s.ctrl &= ~SID_CTRL_NOISE;break;
-		case 4: s.ctrl |= SID_CTRL_RECT; s.ctrl &= ~SID_CTRL_NOISE;break;
-		case 5: s.ctrl |= SID_CTRL_NOISE; s.ctrl &= ~(SID_CTRL_TRI | SID_CTRL_SAW | SID_CTRL_RECT); break;
-		case 6: s.ctrl |= SID_CTRL_GATE; break;
-
-		case  8: if (s.freq < 55536) s.freq += 10000; break;
-		case  9: if (s.freq < 64536) s.freq +=  1000; break;
-		case 10: if (s.freq < 65436) s.freq +=   100; break;
-		case 11: if (s.freq < 65526) s.freq +=    10; break;
-		case 12: if (s.freq < 65535) s.freq +=     1; break;
-
-		case 14: if (s.pwm < 3096) s.pwm +=  1000; break;
-		case 15: if (s.pwm < 3996) s.pwm +=   100; break;
-		case 16: if (s.pwm < 4086) s.pwm +=    10; break;
-		case 17: if (s.pwm < 4085) s.pwm +=     1; break;
-
-		case 19: if ((s.attdec & 0xf0) < 0xf0) s.attdec += 0x10; break;
-		case 20: if ((s.attdec & 0x0f) < 0x0f) s.attdec += 0x01; break;
-		case 21: if ((s.susrel & 0xf0) < 0xf0) s.susrel += 0x10; break;
-		case 22: if ((s.susrel & 0x0f) < 0x0f) s.susrel += 0x01; break;
-
-		case 24: if (s.dfreq < 22768) s.dfreq += 10000; break;
-		case 25: if (s.dfreq < 31768) s.dfreq +=  1000; break;
-		case 26: if (s.dfreq < 32668) s.dfreq +=   100; break;
-		case 27: if (s.dfreq < 32758) s.dfreq +=    10; break;
-		case 28: if (s.dfreq < 32767) s.dfreq +=     1; break;
-
-		case 30: if (s.dpwm < 3096) s.dpwm +=  1000; break;
-		case 31: if (s.dpwm < 3996) s.dpwm +=   100; break;
-		case 32: if (s.dpwm < 4086) s.dpwm +=    10; break;
-		case 33: if (s.dpwm < 4095) s.dpwm +=     1; break;
-
-		case 35: if (s.time1 < 90) s.time1 += 10; break;
-		case 36: if (s.time1 < 99) s.time1 +=  1; break;
-		case 38: if (s.time0 < 90) s.time0 += 10; break;
-		case 39: if (s.time0 < 99) s.time0 +=  1; break;
-
+			for(char r=0; r<n; r++)
+				edit_inc(s);
 		}
 		restart = true;
 		redraw = true;
 		break;
 	case KSCAN_MINUS:
 	case KSCAN_COMMA:
-		switch (cursorX)
+		if (cursorX == 0)
+			edit_delete();
+		else
 		{
-		case 0: 
-			if (neffects > 1)
-			{
-				neffects--;
-				for(char i=cursorY; i<neffects; i++)
-					effects[i] = effects[i + 1];						
-                                redraw_all = true;
-			}
-			break;
-
-		case 2: s.ctrl &= ~SID_CTRL_TRI; break;
-		case 3: s.ctrl &= ~SID_CTRL_SAW; break;
-		case 4: s.ctrl &= ~SID_CTRL_RECT; break;
-		case 5: s.ctrl &= ~SID_CTRL_NOISE; break;
-		case 6: s.ctrl &= ~SID_CTRL_GATE; break;
-
-		case  8: if (s.freq >= 10000) s.freq -= 10000; break;
-		case  9: if (s.freq >=  1000) s.freq -=  1000; break;
-		case 10: if (s.freq >=   100) s.freq -=   100; break;
-		case 11: if (s.freq >=    10) s.freq -=    10; break;
-		case 12: if (s.freq >=     1) s.freq -=     1; break;
-
-		case 14: if (s.pwm >=  1000) s.pwm -=  1000; break;
-		case 15: if (s.pwm >=   100) s.pwm -=   100; break;
-		case 16: if (s.pwm >=    10) s.pwm -=    10; break;
-		case 17: if (s.pwm >=     1) s.pwm -=     1; break;
-
-		case 19: if ((s.attdec & 0xf0) > 0x00) s.attdec -= 0x10; break;
-		case 20: if ((s.attdec & 0x0f) > 0x00) s.attdec -= 0x01; break;
-		case 21: if ((s.susrel & 0xf0) > 0x00) s.susrel -= 0x10; break;
-		case 22: if ((s.susrel & 0x0f) > 0x00) s.susrel -= 0x01; break;
-
-		case 24: if (s.dfreq > -22768) s.dfreq -= 10000; break;
-		case 25: if (s.dfreq > -31768) s.dfreq -=  1000; break;
-		case 26: if (s.dfreq > -32668) s.dfreq -=   100; break;
-		case 27: if (s.dfreq > -32758) s.dfreq -=    10; break;
-		case 28: if (s.dfreq > -32767) s.dfreq -=     1; break;
-
-		case 30: if (s.dpwm > -3096) s.dpwm -=  1000; break;
-		case 31: if (s.dpwm > -3996) s.dpwm -=   100; break;
-		case 32: if (s.dpwm > -4086) s.dpwm -=    10; break;
-		case 33: if (s.dpwm > -4095) s.dpwm -=     1; break;
-
-		case 35: if (s.time1 >= 10) s.time1 -= 10; break;
-		case 36: if (s.time1 >   0) s.time1 -=  1; break;
-		case 38: if (s.time0 >= 10) s.time0 -= 10; break;
-		case 39: if (s.time0 >   0) s.time0 -=  1; break;
+			for(char r=0; r<n; r++)
+				edit_dec(s);
 		}
 		restart = true;
 		redraw = true;
@@ -856,302 +4170,293 @@ void edit_effects(char k)
 		char i = 0;
 		while (i < 16 && k != kscan_digits[i])
 			i++;
-		if (i < 16)
+		if (i < 16 && (!vsid_isloop(s) || BcdField[cursorX] == BCD_TIME1))
 		{
-			check_digit(s, i); 
-			restart = true;
-			redraw = true;
+			if (check_digit(s, view_bcd[cursorY - view_top], i))
+			{
+				restart = true;
+				redraw = true;
+			}
 		}
 		break;
 
 	}
 
-	if (restart)
-	{
-		sidfx_stop(voice);
-		sidfx_play(voice, effects, neffects);
+	// keep the shadow of a field stepped with + or - in line
+	if ((k == KSCAN_PLUS || k == KSCAN_DOT || k == KSCAN_EQUAL || k == KSCAN_MINUS || k == KSCAN_COMMA) && BcdField[cursorX] != BCD_NONE)
+		bcd_sync_field(cursorY, BcdField[cursorX]);
+
+	if (restart && !live_mode && fx_play())
 		irq_cnt = 0;
-	}
 
-	if (redraw_all)
-	{
-		showfxs();
-		hires_draw_start();
-	}
-        else if (redraw)
+	if (redraw)
+		cost_valid = false;
+
+	if (redraw && cursorY < neffects)
 	{
-		showfxs_row(cursorY);		
-		hires_draw_start();
+		char mask = fx_diff(before, s);
+		if (mask)
+		{
+			showfxs_fields(cursorY, mask);
+			hires_draw_from(cursorY);
+		}
 	}
 
 }
 
-enum Phase
-{
-	PHASE_RELEASE,
-	PHASE_OFF,
-	PHASE_ATTACK,
-	PHASE_DECAY
-};
+VirtualSID	vsid;
+
+// The other voices drawn over the edited one, the entry of the edited
+// voice is not used
+VirtualSID	vsid_others[3];
 
-enum SIDFXState
+// Snapshot of the virtual SID at the start of each hires column, so an edit
+// only needs to replay the preview from the first column it can affect
+VirtualSID	vsid_ckpt[40];
+
+void hires_bar(char * dp, const char * ady)
 {
-	SIDFX_IDLE,
-	SIDFX_RESET_0,
-	SIDFX_READY,
-	SIDFX_PLAY,
-	SIDFX_WAIT
+	char c = 0;
+	for(char i=0; i<4; i++)
+	{		
+		for(char j=0; j<8; j+=2)
+		{
+			c |= ady[j];
+			dp[j] = c;
+			c |= ady[j + 1];
+			dp[j + 1] = c ^ 0x22;
+		}
+		dp += 8;
+		ady += 8;
+	}
+}
+
+static const char binlog32[256] = {
+#for(i, 256)	(int)(log(i) / log(2) * 4),
 };
 
-struct VirtualSID
-{	
-	Phase			phase;
-	char			ctrl;
-	char			attdec, susrel;
-	unsigned		adsr, freq, pwm;
-	char			tick, delay, pos;
-	SIDFXState		state;
 
-}	vsid;
+// The preview strip is two bars of 4 text rows by 40 columns, each using
+// chars 0 to 159 of its own charset with column c in chars 4c to 4c+3, so a
+// column is 32 consecutive bytes. Previews are drawn into the back pair of
+// charsets and the raster splits are pointed at them in one go once all 40
+// columns are done. The VIC sees char ROM at 0x9000, so a second bitmap in
+// this bank is not an option.
+static char * const PreviewEnv[2] = {(char *)0xa800, (char *)0xb800};
+static char * const PreviewFrq[2] = {(char *)0xb000, (char *)0x8800};
+static const char PreviewEnvMem[2] = {0x0a, 0x0e};
+static const char PreviewFrqMem[2] = {0x0c, 0x02};
 
-// Maximum value and per frame step for ADSR emulation
-static const unsigned AMAX	= 32 * 256 - 1;
-#ifdef OSFXEDIT_USE_NMI
-static const unsigned TSTEP = nmi_cycles / 1000; // ms/frame
-#else
-static const unsigned TSTEP = 20; // ms/frame
-#endif
-static const unsigned ASTEP = (unsigned long)AMAX * TSTEP / 4;
-
-// ADSR constants
-static const unsigned AttackStep[16] = {
-	ASTEP / 2,   ASTEP / 8,  ASTEP / 16, ASTEP / 24,
-	ASTEP / 38,   ASTEP / 56,  ASTEP / 68, ASTEP / 80,
-	ASTEP / 100,   ASTEP / 250,  ASTEP / 500, ASTEP / 800,
-	ASTEP / 1000,   ASTEP / 3000,  ASTEP / 5000, ASTEP / 8000
-};
+char	preview_front;
+char	preview_valid;	// leading columns of the back pair matching the preview
 
-static const unsigned DecayStep[16] = {
-	ASTEP / 6,   ASTEP / 24,  ASTEP / 48, ASTEP / 72,
-	ASTEP / 114,   ASTEP / 168,  ASTEP / 204, ASTEP / 240,
-	ASTEP / 300,   ASTEP / 750,  ASTEP / 1500, ASTEP / 2400,
-	ASTEP / 3000,   ASTEP / 9000,  ASTEP / 15000, ASTEP / 24000
-};
+// The preview starts where playback reaches the first row in view, the
+// ticks before are run without drawing, a few per call. A loop that
+// never gets there is drawn from where the seek gives up.
+static const char preview_seek_ticks = 4;
+static const unsigned preview_seek_max = 1000;
 
-static const char Count2Level[256] = {
-	#for (i, 256) exp(i / 54.0) / exp(255.0 / 54.0) * 31.0,
-};
+bool		preview_seek;
+unsigned	preview_skip;	// ticks run before the first column
 
-static const char Sustain2Count[16] = {
-	#for (i, 16) log(i * exp(255.0 / 54.0) / 15.0) * 54.0,
-};
+void preview_flip(void)
+{
+	preview_front ^= 1;
+
+	// both splits have to change within the same frame
+	__asm {sei}
+	rirq_data(&rirq_env, 1, PreviewEnvMem[preview_front]);
+	rirq_data(&rirq_frq, 1, PreviewFrqMem[preview_front]);
+	__asm {cli}
 
+	preview_valid = 0;
+}
 
-void vsid_advance(void)
+// XOR the sampled ENV3 over the envelope bar and OSC3 over the frequency
+// bar of the visible preview, a second call removes them again
+void valid_plot(void)
 {
-	if (vsid.ctrl & SID_CTRL_GATE)
+	char	*	ep = PreviewEnv[preview_front];
+	char	*	fp = PreviewFrq[preview_front];
+
+	for(char t=0; t<valid_ticks; t++)
 	{
-		if (vsid.phase < PHASE_ATTACK)
+		// last pixel of the tick, the model value is sampled there too
+		char	m = (t & 1) ? 0x01 : 0x10;
+
+		ep[31 - (valid_env[t] >> 3)] ^= m;
+		fp[31 - (valid_osc[t] >> 3)] ^= m;
+
+		if (t & 1)
 		{
-			vsid.phase = PHASE_ATTACK;
-			vsid.adsr = 0;
+			ep += 32;
+			fp += 32;
 		}
 	}
-	else
-	{
-		if (vsid.phase >= PHASE_ATTACK)
-			vsid.phase = PHASE_RELEASE;
-	}
+}
 
-	switch (vsid.phase)
-	{
-	case PHASE_ATTACK:
-		// Increase channel power during attack phase
-		vsid.adsr += AttackStep[vsid.attdec >> 4];
-		if (vsid.adsr >= AMAX)
-		{
-			// Switch to decay phase next
-			vsid.adsr = AMAX;
-			vsid.phase = PHASE_DECAY;
-		}
-		break;
-	case PHASE_DECAY:
-		{
-			// Decrease channel power during decay phase
-			unsigned sus = Sustain2Count[vsid.susrel >> 4] << 5;
-			unsigned dec = DecayStep[vsid.attdec & 0x0f];
+void valid_report(void)
+{
+	VirtualSID	v;
+	char		dmax = 0, tmax = 0;
 
-			if (vsid.adsr > sus + dec)
-				vsid.adsr -= dec;
-			else if (vsid.adsr > sus)
-				vsid.adsr = sus;
-		}
-		break;
-	case PHASE_RELEASE:
+	vsid_reset(v);
+	for(char t=0; t<valid_ticks; t++)
+	{
+		vsid_tick(v, voice_fx[2], voice_nrows(2));
+		for(char i=0; i<VSID_SUBSTEPS; i++)
+			vsid_advance(v);
+
+		// the fast model level 0..31 is scaled to the 0..255 of ENV3
+		char	p = vsid_accurate ? v.env : (vsid_level(v) * 33) >> 2;
+		char	e = valid_env[t];
+		char	d = e > p ? e - p : p - e;
+		if (d > dmax)
 		{
-			// Decrease channel power during release phase
-			unsigned dec = DecayStep[vsid.susrel & 0x0f];
-
-			if (vsid.adsr > dec)
-				vsid.adsr -= dec;
-			else
-			{
-				// Switch to off when energy reaches flat
-				vsid.adsr = 0;
-				vsid.phase = PHASE_OFF;
-			}
+			dmax = d;
+			tmax = t;
 		}
-		break;
 	}
 
+	// the samples start with the effect, so they only line up with a
+	// preview that does too
+	if (!preview_skip)
+	{
+		valid_plot();
+		valid_shown = true;
+	}
 
+	char	msg[48];
+	sprintf(msg, "ENV3 MAX DEVIATION %u AT TICK %u", dmax, tmax);
+	show_msg(msg, true);
 }
 
-void hires_bar(char * dp, const char * ady)
+void hires_draw_start(void)
 {
-	char c = 0;
-	for(char i=0; i<4; i++)
-	{		
-		for(char j=0; j<8; j+=2)
-		{
-			c |= ady[j];
-			dp[j] = c;
-			c |= ady[j + 1];
-			dp[j + 1] = c ^ 0x22;
-		}
-		dp += 320;
-		ady += 8;
+	if (valid_shown)
+	{
+		valid_plot();
+		valid_shown = false;
 	}
+	vsid_reset(vsid);
+	for(char ch=0; ch<3; ch++)
+		vsid_reset(vsid_others[ch]);
+	preview_valid = 0;
+	preview_seek = view_top != 0;
+	preview_skip = 0;
 }
 
-static const char binlog32[256] = {
-#for(i, 256)	(int)(log(i) / log(2) * 4),
-};
+// Resume the preview from the last column that started before effect row
+// was reached, keeping the columns to its left as they are
+void hires_draw_from(char row)
+{
+	char c = 0;
+	while (c + 1 < vsid.tick && vsid_ckpt[c + 1].pos < row)
+		c++;
 
+	if (valid_shown)
+	{
+		valid_plot();
+		valid_shown = false;
+	}
 
-void hires_draw_start(void)
-{
-	vsid.phase = PHASE_OFF;
-	vsid.ctrl = 0;
-	vsid.state = SIDFX_READY;
-	vsid.delay = 1;
-	vsid.tick = 0;
-	vsid.pos = 0;
+	// a loop can come back to the row after the columns that start before
+	// it, the other voices have no snapshots
+	if (vsid.tick && vsid_ckpt[c].pos < row && !fx_has_loop(effects, neffects) && neffects == fx_total())
+	{
+		vsid = vsid_ckpt[c];
+		if (preview_valid > vsid.tick)
+			preview_valid = vsid.tick;
+	}
+	else
+		hires_draw_start();
 }
 
 void hires_draw_tick(void)
 {
 	char ady[32], fry[32];
 
-	if (vsid.tick < 40)
+	if (preview_seek)
+	{
+		for(char i=0; i<preview_seek_ticks && vsid.pos < view_top && vsid.state != SIDFX_IDLE; i++)
+		{
+			vsid_tick(vsid, effects, neffects);
+			for(char j=0; j<VSID_SUBSTEPS; j++)
+				vsid_advance(vsid);
+			for(char ch=0; ch<3; ch++)
+			{
+				if (ch != voice && voice_rows[ch])
+				{
+					VirtualSID	&	o = vsid_others[ch];
+					vsid_tick(o, voice_fx[ch], voice_rows[ch]);
+					for(char j=0; j<VSID_SUBSTEPS; j++)
+						vsid_advance(o);
+				}
+			}
+			preview_skip++;
+		}
+		if (vsid.pos >= view_top || vsid.state == SIDFX_IDLE || preview_skip >= preview_seek_max)
+			preview_seek = false;
+	}
+	else if (vsid.tick < 40)
 	{
+		char	back = preview_front ^ 1;
+
+		// the columns left of a resumed preview are still those on show
+		if (preview_valid < vsid.tick)
+		{
+			memcpy(PreviewEnv[back] + 32 * preview_valid, PreviewEnv[preview_front] + 32 * preview_valid, 32);
+			memcpy(PreviewFrq[back] + 32 * preview_valid, PreviewFrq[preview_front] + 32 * preview_valid, 32);
+			preview_valid++;
+			return;
+		}
+
+		vsid_ckpt[vsid.tick] = vsid;
+
 		for(char i=0; i<32; i++)
 			ady[i] = fry[i] = 0;
 
 		for(char n=0; n<2; n++)
 		{
-			const SIDFX	*	com = effects + vsid.pos;
-			vsid.delay--;
-			if (vsid.delay)
+			vsid_tick(vsid, effects, neffects);
+
+			for(char i=0; i<4; i++)
 			{
-				if (com->dfreq)
-					vsid.freq += com->dfreq;
-				if (com->dpwm)
-					vsid.pwm += com->dpwm;				
+				char j = i + 4 * n;
+				vsid_advance(vsid);
+				ady[31 - vsid_level(vsid)] |= 128 >> j;
+				fry[31 - binlog32[vsid.freq >> 8]] |= 128 >> j;
 			}
-			while (!vsid.delay)
+		}
+
+		// the other voices go into the same bars
+		for(char ch=0; ch<3; ch++)
+		{
+			if (ch != voice && voice_rows[ch])
 			{
-				switch (vsid.state)
+				VirtualSID	&	o = vsid_others[ch];
+				for(char n=0; n<2; n++)
 				{
-				case SIDFX_IDLE:
-					vsid.delay = 1;
-					break;
-				case SIDFX_RESET_0:
-					vsid.ctrl = 0;
-					vsid.attdec = 0;
-					vsid.susrel = 0;
-					vsid.state = SIDFX_READY;
-					vsid.delay = 1;
-					break;
-				case SIDFX_READY:
-					if (vsid.pos < neffects)
-					{
-						vsid.freq = com->freq;
-						vsid.pwm = com->pwm;
-						vsid.attdec = com->attdec;
-						vsid.susrel = com->susrel;
-						vsid.ctrl = com->ctrl;
-
-						if (com->ctrl & SID_CTRL_GATE)
-						{
-							vsid.delay = com->time1;
-							vsid.state = SIDFX_PLAY;
-						}
-						else
-						{
-							vsid.delay = com->time0;
-							vsid.state = SIDFX_WAIT;
-						}
-					}
-					else
-						vsid.state = SIDFX_IDLE;
-					break;
-				case SIDFX_PLAY:
-					if (com->time0)
-					{
-						vsid.ctrl = com->ctrl & ~SID_CTRL_GATE;
-						vsid.delay = com->time0 - 1;
-						vsid.state = SIDFX_WAIT;
-					}
-					else
-					{
-						vsid.pos++;
-						if (vsid.pos < neffects)
-						{
-							char sr = com->susrel & 0xf0;
-							com++;
-							if ((com->attdec & 0xef) == 0 && (com->ctrl & SID_CTRL_GATE) && (com->susrel & 0xf0) > sr)
-								vsid.phase = PHASE_RELEASE;
-							vsid.state = SIDFX_READY;
-						}
-						else
-							vsid.state = SIDFX_RESET_0;
-					}
-					break;
-				case SIDFX_WAIT:
-					vsid.pos++;
-					if (vsid.pos < neffects)
+					vsid_tick(o, voice_fx[ch], voice_rows[ch]);
+
+					for(char i=0; i<4; i++)
 					{
-						com++;
-						if (com->ctrl & SID_CTRL_GATE)
-							vsid.state = SIDFX_RESET_0;
-						else
-							vsid.state = SIDFX_READY;
+						char j = i + 4 * n;
+						vsid_advance(o);
+						ady[31 - vsid_level(o)] |= 128 >> j;
+						fry[31 - binlog32[o.freq >> 8]] |= 128 >> j;
 					}
-					else
-						vsid.state = SIDFX_RESET_0;
-					break;
 				}
 			}
-
-
-			for(char i=0; i<4; i++)
-			{
-				char j = i + 4 * n;
-				vsid_advance();
-				if (vsid.phase == PHASE_ATTACK)
-					ady[31 - (vsid.adsr >> 8)] |= 128 >> j;
-				else
-					ady[31 - Count2Level[vsid.adsr >> 5]] |= 128 >> j;
-				fry[31 - binlog32[vsid.freq >> 8]] |= 128 >> j;
-			}
 		}
 
-		char * dp = Hires + 320 * (max_neffects + 2) + 8 * vsid.tick;
-		hires_bar(dp, ady);
-		dp += 320 * 4;
-		hires_bar(dp, fry);	
+		hires_bar(PreviewEnv[back] + 32 * vsid.tick, ady);
+		hires_bar(PreviewFrq[back] + 32 * vsid.tick, fry);
 		vsid.tick++;
+		preview_valid = vsid.tick;
+
+		if (vsid.tick == 40)
+			preview_flip();
 	}
 }
 
@@ -1161,8 +4466,11 @@ int main(void)
 
 	cia_init();
 
+	sys_pal = detect_pal();
+	tod_init();
+
 	mmap_set(MMAP_CHAR_ROM);
-	memcpy(Hires, ROMFont, 0x0800); // use redundant 1st half of hires to store font
+	memcpy(Hires, ROMFont, 0x0800); // font, the preview charsets follow it
 	mmap_set(MMAP_NO_BASIC);
 	memcpy((char*)0xe000, (char*)0xe000, 0x2000); // copy ROM to RAM
 	mmap_set(MMAP_NO_ROM);
@@ -1178,20 +4486,26 @@ int main(void)
 
 	vic_setmode(VICM_TEXT, Screen, Hires);
 
-#ifdef OSFXEDIT_USE_NMI
+	cia2.tb  = 0xffff;
+	cia2.crb = 0b00010001; // free running cycle counter
+
+	unsigned t = cycles_now();
+	prof_bias = t - cycles_now();
+
 	*(void**)0xfffa = nmi_isr_stub;
-	vic_waitLine(nmi_start_rasterline); // start in consistent place to avoid flicker at hires transition
-	cia2.ta	 = nmi_cycles;
-	cia2.icr = 0b10000001;
-	cia2.cra = 0b00010001;
+#ifdef OSFXEDIT_USE_NMI
+	tick_set(true);
+#else
+	tick_set(false);
 #endif
 
 	sidfx_init();
+	sfxpack_init();
 
 	rirq_init_kernal();
 
 	rirq_build(&rirq_isr, 2);
-	rirq_write(&rirq_isr, 0, &vic.ctrl1, VIC_CTRL1_DEN | VIC_CTRL1_RSEL | 3);
+	rirq_write(&rirq_isr, 0, &vic.memptr, 0x08); // font at Hires
 	rirq_call(&rirq_isr, 1, isr);
 	rirq_set(0, 250, &rirq_isr);
 
@@ -1201,10 +4515,15 @@ int main(void)
 	rirq_build(&rirq_mark1, 1);
 	rirq_write(&rirq_mark1, 0, &vic.color_back, VCOL_BLACK);
 
-	rirq_build(&rirq_bitmap, 2);
-	rirq_delay(&rirq_bitmap, 10);
-	rirq_write(&rirq_bitmap, 1, &vic.ctrl1, VIC_CTRL1_DEN | VIC_CTRL1_RSEL | VIC_CTRL1_BMM | 3);
-	rirq_set(3, 49 + 8 * (max_neffects + 2), &rirq_bitmap);
+	rirq_build(&rirq_env, 2);
+	rirq_delay(&rirq_env, 10);
+	rirq_write(&rirq_env, 1, &vic.memptr, PreviewEnvMem[0]);
+	rirq_set(3, 49 + 8 * (view_rows + 2), &rirq_env);
+
+	rirq_build(&rirq_frq, 2);
+	rirq_delay(&rirq_frq, 10);
+	rirq_write(&rirq_frq, 1, &vic.memptr, PreviewFrqMem[0]);
+	rirq_set(4, 49 + 8 * (view_rows + 6), &rirq_frq);
 
 	rirq_sort();
 	rirq_start();
@@ -1216,16 +4535,32 @@ int main(void)
 
 	memset(Screen, 0x10, 1000);
 
-	effects[0] = basefx;
-	neffects = 1;
+	edit_new();
 
 	showfxs();		
 	showmenu();
 	hires_draw_start();
 
-	memset(Hires + (max_neffects + 2) * 320, 0, 13 * 320);
-	memset(Screen + (max_neffects + 2) * 40, 0x70, 160);
-	memset(Screen + (max_neffects + 2 + 4) * 40, 0xe0, 160);
+	for(char i=0; i<2; i++)
+	{
+		memset(PreviewEnv[i], 0, 160 * 8);
+		memset(PreviewFrq[i], 0, 160 * 8);
+	}
+	for(char i=0; i<4; i++)
+	{
+		char * dp = Screen + (view_rows + 2 + i) * 40;
+		char * cp = Color + (view_rows + 2 + i) * 40;
+		for(char j=0; j<40; j++)
+		{
+			dp[j] = dp[j + 160] = 4 * j + i;
+			cp[j] = VCOL_YELLOW;
+			cp[j + 160] = VCOL_LT_BLUE;
+		}
+	}
+
+#ifdef OSFXEDIT_BENCH
+	bench_redraw();
+#endif
 
 	spr_set(0, true, 0, 0, sprite_img_base + 0, VCOL_WHITE, false, false, false);
 	spr_set(1, true, 0, 0, sprite_img_base + 2, VCOL_BLUE, false, false, true);
@@ -1236,12 +4571,15 @@ int main(void)
 	bool	markset = false;
 	for(;;)
 	{
-		char * curp = Screen + 40 + 40 * cursorY + cursorX;
-		char * curc = Color + 40 + 40 * cursorY + cursorX;
+		char cy = cursorY == max_neffects ? view_rows : cursorY - view_top;
+		char * curp = Screen + 40 + 40 * cy + cursorX;
+		char * curc = Color + 40 + 40 * cy + cursorX;
 
-		if (cursorY < max_neffects || cursorX >= 20)
+		if (list_mode || stress_run)
+			spr_move(0, 0, 0);
+		else if (cursorY < max_neffects || cursorX >= 20)
 		{
-			spr_move(0, 24 + 8 * cursorX, 49 + 8 + 8 * cursorY);
+			spr_move(0, 24 + 8 * cursorX, 49 + 8 + 8 * cy);
 			spr_image(0, sprite_img_base + ((csr_cnt >> 4) & 1));
 		}
 		else
@@ -1251,14 +4589,22 @@ int main(void)
 				curc[i] = VCOL_YELLOW;
 		}
 
-		// vic.color_border = VCOL_ORANGE;
-		hires_draw_tick();
-		hires_draw_tick();
-		hires_draw_tick();
-		// vic.color_border = VCOL_BLACK;
+		// draw preview columns while there is raster time left, the lines
+		// past 255 are the start of the next frame's budget
+		while (vsid.tick < 40 && ((vic.ctrl1 & VIC_CTRL1_RST8) || vic.raster < preview_safety_line))
+		{
+			unsigned t = prof_begin();
+			hires_draw_tick();
+			prof_end(PROF_HIRES, t);
+		}
 
 		vic_waitBottom();
-		if (sidfx_idle(voice))
+		unsigned tmark = prof_begin();
+		if (live_mode && cursorY < neffects)
+			live_row = cursorY;
+
+		// the stress test covers the rows the marker would show
+		if ((fx_all_idle() && !live_mode) || stress_run)
 		{
 			spr_move(1, 0, 0);
 			spr_move(2, 0, 0);
@@ -1272,10 +4618,12 @@ int main(void)
 		}
 		else
 		{
-			if (irq_cnt < 100)
+			// the preview starts with the first row in view
+			unsigned pt = irq_cnt - preview_skip;
+			if (irq_cnt >= preview_skip && pt < 100)
 			{
-				spr_move(1, 24 + 4 * irq_cnt, (max_neffects + 2) * 8 + 49);
-				spr_move(2, 24 + 4 * irq_cnt, (max_neffects + 2 + 3) * 8 + 49);
+				spr_move(1, 24 + 4 * pt, (view_rows + 2) * 8 + 49);
+				spr_move(2, 24 + 4 * pt, (view_rows + 2 + 3) * 8 + 49);
 			}
 			else
 			{
@@ -1283,22 +4631,84 @@ int main(void)
 				spr_move(2, 0, 0);
 			}
 
-			char sx = (neffects - sidfx_cnt(voice)) * 8 + 49;
-			if (!markset)
+			// the row marker is the one of the edited voice
+			char r = (live_mode ? live_row : fx_row(voice)) - view_top;
+			if (r >= view_rows || (!live_mode && fx_idle(voice)))
 			{
-				rirq_set(1, sx, &rirq_mark0); 
-				rirq_set(2, sx + 8, &rirq_mark1); 
-				markset = true;
+				if (markset)
+				{
+					rirq_clear(1); rirq_clear(2);
+					markset = false;
+				}
 			}
 			else
 			{
-				rirq_move(1, sx); 
-				rirq_move(2, sx + 8); 
+				char sx = (r + 1) * 8 + 49;
+				if (!markset)
+				{
+					rirq_set(1, sx, &rirq_mark0); 
+					rirq_set(2, sx + 8, &rirq_mark1); 
+					markset = true;
+				}
+				else
+				{
+					rirq_move(1, sx); 
+					rirq_move(2, sx + 8); 
+				}
 			}
 			rirq_sort();
 		}
 
-		if (cursorY < max_neffects || cursorX >= 20)
+		prof_end(PROF_MARK, tmark);
+
+		if (io_job)
+			io_step();
+
+		// reports wait for the menu line while a job has it
+		if (cost_done && !io_job)
+		{
+			cost_done = false;
+			if (opt_state == 1)
+				opt_merge();
+			else if (opt_state == 2)
+				opt_report();
+			else
+				cost_report();
+		}
+
+		if (fx_bad_done && !io_job)
+		{
+			char	msg[] = S"loop in row 00 of v1 cannot be played";
+			fx_bad_done = false;
+			msg[12] = HexDigit[fx_bad >> 4];
+			msg[13] = HexDigit[fx_bad & 0x0f];
+			msg[19] = '1' + fx_bad_voice;
+			show_msg(msg);
+		}
+
+		// wait for the preview to settle, the samples go over it
+		if (valid_done && vsid.tick == 40 && !io_job)
+		{
+			valid_done = false;
+			valid_report();
+		}
+
+		if (prof_show)
+		{
+			// the profiler line covers the menu, give it back when entering it
+			if (cursorY == max_neffects)
+				prof_toggle_off();
+			else if (++prof_frames == 50)
+				prof_update();
+		}
+
+		if (stress_run && ++stress_frames == 25)
+		{
+			stress_frames = 0;
+			stress_show();
+		}
+
+		if (cursorY < max_neffects || cursorX >= 20 || stress_run)
 			;
 		else
 		{
@@ -1306,16 +4716,37 @@ int main(void)
 				curc[i] = VCOL_LT_BLUE;
 		}
 
-		if (keyb_queue & KSCAN_QUAL_DOWN)
+		// drain all keys of this frame, runs of the same + or - key are
+		// merged into one change
+		while (keyb_tail != keyb_head)
 		{
 			csr_cnt = 16;
 
-			char k = keyb_queue & KSCAN_QUAL_MASK;
-			keyb_queue = 0;
+			char k = keyb_pop() & KSCAN_QUAL_MASK;
+			char n = 1;
+
+			// rows are inserted and deleted one key at a time
+			bool	rowkey = cursorX == 0 && cursorY < max_neffects;
+			if ((k == KSCAN_PLUS || k == KSCAN_DOT || k == KSCAN_EQUAL || k == KSCAN_MINUS || k == KSCAN_COMMA) && !rowkey)
+			{
+				while (n < 255 && keyb_tail != keyb_head && (keyb_ring[keyb_tail] & KSCAN_QUAL_MASK) == k)
+				{
+					keyb_pop();
+					n++;
+				}
+			}
 
-			if (cursorY < max_neffects)
+			if (list_mode)
+				list_key(k);
+			else if (io_job)
+				io_key(k);
+			else if (stress_run)
+				stress_key(k, n);
+			else if (edit_global(k))
+				;
+			else if (cursorY < max_neffects)
 			{
-				edit_effects(k);
+				edit_effects(k, n);
 				if (cursorY == max_neffects)
 				{
 					if (cursorX < 20)
@@ -1329,8 +4760,11 @@ int main(void)
 			}
 			else
 			{
-				edit_menu(k);
+				for(char r=0; r<n; r++)
+					edit_menu(k);
 			}
+
+			view_follow();
 		}
 	}
 }
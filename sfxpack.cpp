@@ -0,0 +1,177 @@
+#include "sfxpack.h"
+
+SfxPackVoice	sfxpack_voices[3];
+
+void sfxpack_init(void)
+{
+	for(char i=0; i<3; i++)
+		sfxpack_voices[i].state = SIDFX_IDLE;
+}
+
+// Unpack the row after the current one, following loop rows the way
+// vsid_next does, returns false at the end
+static bool sfxpack_next(SfxPackVoice & v)
+{
+	char			pos = v.pos + 1;
+	const char	*	sp = v.next;
+
+	while (pos < v.n && sfxpack_isloop(sp))
+	{
+		char cnt = sp[3];
+		if (cnt)
+		{
+			if (!v.loop)
+				v.loop = cnt;
+			v.loop--;
+		}
+
+		if (!cnt || v.loop)
+		{
+			if (v.jumped || sp[2] >= v.n)
+				return false;
+			v.jumped = true;
+			pos = sp[2];
+			sp = v.data + sfxpack_word(sp + 4);
+		}
+		else
+		{
+			pos++;
+			sp += SFXP_LOOPROW;
+		}
+	}
+
+	if (pos >= v.n)
+		return false;
+
+	v.pos = pos;
+	v.next = sfxpack_decode(v.row, sp);
+	return true;
+}
+
+void sfxpack_play(char ch, const char * data)
+{
+	SfxPackVoice	&	v = sfxpack_voices[ch];
+
+	v.state = SIDFX_IDLE;
+	v.data = data;
+	v.n = data[0];
+	if (v.n && !sfxpack_isloop(data + 1))
+	{
+		memset(&v.row, 0, sizeof(SIDFX));
+		v.next = sfxpack_decode(v.row, data + 1);
+		v.pos = 0;
+		v.loop = 0;
+		v.last = false;
+		v.delay = 1;
+		v.state = SIDFX_READY;
+	}
+}
+
+void sfxpack_stop(char ch)
+{
+	sfxpack_voices[ch].state = SIDFX_IDLE;
+	sid.voices[ch].ctrl = 0;
+	sid.voices[ch].attdec = 0;
+	sid.voices[ch].susrel = 0;
+}
+
+static void sfxpack_loop_ch(char ch)
+{
+	SfxPackVoice	&	v = sfxpack_voices[ch];
+
+	v.delay--;
+	if (v.delay)
+	{
+		if (v.row.dfreq)
+		{
+			v.freq += v.row.dfreq;
+			sid.voices[ch].freq = v.freq;
+		}
+		if (v.row.dpwm)
+		{
+			v.pwm += v.row.dpwm;
+			sid.voices[ch].pwm = v.pwm;
+		}
+		return;
+	}
+
+	v.jumped = false;
+	while (!v.delay)
+	{
+		switch (v.state)
+		{
+		case SIDFX_RESET_0:
+			sid.voices[ch].ctrl = 0;
+			sid.voices[ch].attdec = 0;
+			sid.voices[ch].susrel = 0;
+			v.state = v.last ? SIDFX_IDLE : SIDFX_READY;
+			v.delay = 1;
+			break;
+		case SIDFX_READY:
+			v.freq = v.row.freq;
+			v.pwm = v.row.pwm;
+			sid.voices[ch].freq = v.row.freq;
+			sid.voices[ch].pwm = v.row.pwm;
+			sid.voices[ch].attdec = v.row.attdec;
+			sid.voices[ch].susrel = v.row.susrel;
+			sid.voices[ch].ctrl = v.row.ctrl;
+
+			if (v.row.ctrl & SID_CTRL_GATE)
+			{
+				v.delay = v.row.time1;
+				v.state = SIDFX_PLAY;
+			}
+			else
+			{
+				v.delay = v.row.time0;
+				v.state = SIDFX_WAIT;
+			}
+			break;
+		case SIDFX_PLAY:
+			if (v.row.time0)
+			{
+				sid.voices[ch].ctrl = v.row.ctrl & ~SID_CTRL_GATE;
+				v.delay = v.row.time0 - 1;
+				v.state = SIDFX_WAIT;
+			}
+			else
+			{
+				// a louder sustain without attack and decay releases first
+				char sr = v.row.susrel & 0xf0;
+				if (sfxpack_next(v))
+				{
+					if ((v.row.attdec & 0xef) == 0 && (v.row.ctrl & SID_CTRL_GATE) && (v.row.susrel & 0xf0) > sr)
+						sid.voices[ch].ctrl = v.row.ctrl & ~SID_CTRL_GATE;
+					v.state = SIDFX_READY;
+				}
+				else
+				{
+					v.last = true;
+					v.state = SIDFX_RESET_0;
+				}
+			}
+			break;
+		case SIDFX_WAIT:
+			if (sfxpack_next(v))
+				v.state = (v.row.ctrl & SID_CTRL_GATE) ? SIDFX_RESET_0 : SIDFX_READY;
+			else
+			{
+				v.last = true;
+				v.state = SIDFX_RESET_0;
+			}
+			break;
+		default:
+			v.delay = 1;
+			break;
+		}
+	}
+}
+
+void sfxpack_loop(void)
+{
+	for(char ch=0; ch<3; ch++)
+	{
+		if (sfxpack_voices[ch].state != SIDFX_IDLE)
+			sfxpack_loop_ch(ch);
+	}
+}
@@ -0,0 +1,257 @@
+#ifndef SFXPACK_H
+#define SFXPACK_H
+
+// Packed effect lists and a lean player for them. A stream is the row
+// count followed by the rows, each row is a byte with a bit per field and
+// the fields that differ from the row before, low byte first. Fields not
+// in the stream keep the value of the previous row, the row before the
+// first is all zero. The priority byte of SIDFX is not stored.
+//
+// A loop row (see vsid_isloop) is the mask SFXP_CTRL and SID_CTRL_TEST
+// followed by its first row, its count and the offset of the first row
+// in the stream. It leaves the fields alone, and rows a loop goes back to
+// are stored with all fields, so they unpack the same on every pass.
+//
+// The encoder and decoder build with oscar64 and a host C++ compiler (with
+// -funsigned-char), the player is for oscar64 only, compiled from
+// sfxpack.cpp, and writes the SID the way sidfx_loop_2 does for the same
+// rows.
+
+#include "vsid.h"
+#include <string.h>
+
+enum SfxPackField
+{
+	SFXP_FREQ	= 0x01,
+	SFXP_PWM	= 0x02,
+	SFXP_CTRL	= 0x04,
+	SFXP_ATTDEC	= 0x08,
+	SFXP_SUSREL	= 0x10,
+	SFXP_DFREQ	= 0x20,
+	SFXP_DPWM	= 0x40,
+	SFXP_TIME	= 0x80		// time1 and time0
+};
+
+// Largest packed row, mask and all fields
+static const char SFXP_MAXROW = 14;
+static const char SFXP_LOOPROW = 6;
+
+inline vsid_u16 sfxpack_word(const char * sp)
+{
+	return sp[0] | ((vsid_u16)sp[1] << 8);
+}
+
+inline bool sfxpack_isloop(const char * sp)
+{
+	return sp[0] == SFXP_CTRL && sp[1] == SID_CTRL_TEST;
+}
+
+// Bytes of the packed row at sp
+inline char sfxpack_rowsize(const char * sp)
+{
+	if (sfxpack_isloop(sp))
+		return SFXP_LOOPROW;
+
+	char m = sp[0];
+	char n = 1;
+	if (m & SFXP_FREQ)		n += 2;
+	if (m & SFXP_PWM)		n += 2;
+	if (m & SFXP_CTRL)		n++;
+	if (m & SFXP_ATTDEC)	n++;
+	if (m & SFXP_SUSREL)	n++;
+	if (m & SFXP_DFREQ)		n += 2;
+	if (m & SFXP_DPWM)		n += 2;
+	if (m & SFXP_TIME)		n += 2;
+	return n;
+}
+
+// Pack n rows of fx into dp, returns the size of the stream, at most
+// 1 + n * SFXP_MAXROW
+inline unsigned sfxpack_encode(char * dp, const SIDFX * fx, char n)
+{
+	SIDFX	p;
+	memset(&p, 0, sizeof(SIDFX));
+
+	// rows a loop goes back to, one bit each
+	char	targets[32];
+	memset(targets, 0, 32);
+	for(char i=0; i<n; i++)
+	{
+		if (vsid_isloop(fx[i]) && fx[i].freq < i)
+			targets[fx[i].freq >> 3] |= 1 << (fx[i].freq & 7);
+	}
+
+	char	*	sp = dp;
+	*dp++ = n;
+
+	for(char i=0; i<n; i++)
+	{
+		const SIDFX	&	s = fx[i];
+
+		if (vsid_isloop(s))
+		{
+			// a loop ahead of itself ends the effect, it has no offset as
+			// its rows are not written yet
+			char		t = n;
+			unsigned	ofs = 0;
+			if (s.freq < i)
+			{
+				const char *	tp = sp + 1;
+				for(char j=0; j<s.freq; j++)
+					tp += sfxpack_rowsize(tp);
+				t = s.freq;
+				ofs = tp - sp;
+			}
+
+			dp[0] = SFXP_CTRL;
+			dp[1] = SID_CTRL_TEST;
+			dp[2] = t;
+			dp[3] = s.time1;
+			dp[4] = ofs & 0xff;
+			dp[5] = ofs >> 8;
+			dp += SFXP_LOOPROW;
+			continue;
+		}
+
+		bool			full = targets[i >> 3] & (1 << (i & 7));
+		char		*	mp = dp++;
+		char			m = 0;
+
+		if (full || s.freq != p.freq)
+		{
+			m |= SFXP_FREQ;
+			*dp++ = s.freq & 0xff;
+			*dp++ = s.freq >> 8;
+		}
+		if (full || s.pwm != p.pwm)
+		{
+			m |= SFXP_PWM;
+			*dp++ = s.pwm & 0xff;
+			*dp++ = s.pwm >> 8;
+		}
+		if (full || s.ctrl != p.ctrl)
+		{
+			m |= SFXP_CTRL;
+			*dp++ = s.ctrl;
+		}
+		if (full || s.attdec != p.attdec)
+		{
+			m |= SFXP_ATTDEC;
+			*dp++ = s.attdec;
+		}
+		if (full || s.susrel != p.susrel)
+		{
+			m |= SFXP_SUSREL;
+			*dp++ = s.susrel;
+		}
+		if (full || s.dfreq != p.dfreq)
+		{
+			m |= SFXP_DFREQ;
+			*dp++ = s.dfreq & 0xff;
+			*dp++ = (vsid_u16)s.dfreq >> 8;
+		}
+		if (full || s.dpwm != p.dpwm)
+		{
+			m |= SFXP_DPWM;
+			*dp++ = s.dpwm & 0xff;
+			*dp++ = (vsid_u16)s.dpwm >> 8;
+		}
+		if (full || s.time1 != p.time1 || s.time0 != p.time0)
+		{
+			m |= SFXP_TIME;
+			*dp++ = s.time1;
+			*dp++ = s.time0;
+		}
+
+		*mp = m;
+		p = s;
+	}
+
+	return dp - sp;
+}
+
+// Apply the packed row at sp to r, returns the start of the next row
+inline const char * sfxpack_decode(SIDFX & r, const char * sp)
+{
+	char m = *sp++;
+
+	if (m & SFXP_FREQ)
+	{
+		r.freq = sfxpack_word(sp);
+		sp += 2;
+	}
+	if (m & SFXP_PWM)
+	{
+		r.pwm = sfxpack_word(sp);
+		sp += 2;
+	}
+	if (m & SFXP_CTRL)
+		r.ctrl = *sp++;
+	if (m & SFXP_ATTDEC)
+		r.attdec = *sp++;
+	if (m & SFXP_SUSREL)
+		r.susrel = *sp++;
+	if (m & SFXP_DFREQ)
+	{
+		r.dfreq = sfxpack_word(sp);
+		sp += 2;
+	}
+	if (m & SFXP_DPWM)
+	{
+		r.dpwm = sfxpack_word(sp);
+		sp += 2;
+	}
+	if (m & SFXP_TIME)
+	{
+		r.time1 = sp[0];
+		r.time0 = sp[1];
+		sp += 2;
+	}
+
+	return sp;
+}
+
+#ifdef __OSCAR64C__
+
+// Only the current row is kept unpacked, the next one is decoded over it
+// when the player moves on
+struct SfxPackVoice
+{
+	const char	*	data;
+	const char	*	next;
+	char			n, pos;
+	char			delay;
+	SIDFXState		state;
+	char			loop;
+	bool			jumped, last;
+	unsigned		freq, pwm;
+	SIDFX			row;
+};
+
+extern SfxPackVoice	sfxpack_voices[3];
+
+void sfxpack_init(void);
+
+void sfxpack_play(char ch, const char * data);
+
+void sfxpack_stop(char ch);
+
+inline bool sfxpack_idle(char ch)
+{
+	return sfxpack_voices[ch].state == SIDFX_IDLE;
+}
+
+// Row being played, counted in the rows before packing
+inline char sfxpack_row(char ch)
+{
+	return sfxpack_voices[ch].pos;
+}
+
+// Call once per tick
+void sfxpack_loop(void);
+
+#pragma compile("sfxpack.cpp")
+
+#endif
+
+#endif
@@ -0,0 +1,13 @@
+#include "vsid.h"
+
+// The state of the preview model, once for all translation units that
+// include vsid.h
+
+bool	vsid_accurate;
+
+#ifndef __OSCAR64C__
+char	Count2Level[256], Sustain2Count[16];
+#endif
+
+unsigned	AttackStep[16], DecayStep[16];
+unsigned	EBATCH, EnvHits[16], EnvRem[16];
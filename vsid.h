@@ -0,0 +1,474 @@
+#ifndef VSID_H
+#define VSID_H
+
+// Virtual SID voice that replays a SIDFX list the way sidfx_loop_2 does,
+// without touching the chip. Used by the editor for the preview strip and
+// by the host tools in host/, so it has to build with oscar64 and with a
+// host C++ compiler (with -funsigned-char to match the C64 char).
+
+#ifdef __OSCAR64C__
+
+#include <audio/sidfx.h>
+#include <c64/sid.h>
+#include <math.h>
+
+typedef unsigned	vsid_u16;
+
+#else
+
+#include <stdint.h>
+#include <math.h>
+
+typedef uint16_t	vsid_u16;
+
+#define SID_CTRL_GATE	0x01
+#define SID_CTRL_SYNC	0x02
+#define SID_CTRL_RING	0x04
+#define SID_CTRL_TEST	0x08
+#define SID_CTRL_TRI	0x10
+#define SID_CTRL_SAW	0x20
+#define SID_CTRL_RECT	0x40
+#define SID_CTRL_NOISE	0x80
+
+// Same layout as the oscar64 struct, it is what the .sfx files contain
+#pragma pack(push, 1)
+struct SIDFX
+{
+	uint16_t	freq, pwm;
+	uint8_t		ctrl, attdec, susrel;
+	int16_t		dfreq, dpwm;
+	uint8_t		time1, time0;
+	uint8_t		priority;
+};
+#pragma pack(pop)
+
+static_assert(sizeof(SIDFX) == 14, "SIDFX has to match the C64 layout");
+
+#endif
+
+enum Phase
+{
+	PHASE_RELEASE,
+	PHASE_OFF,
+	PHASE_ATTACK,
+	PHASE_DECAY
+};
+
+enum SIDFXState
+{
+	SIDFX_IDLE,
+	SIDFX_RESET_0,
+	SIDFX_READY,
+	SIDFX_PLAY,
+	SIDFX_WAIT
+};
+
+struct VirtualSID
+{
+	Phase			phase;
+	char			ctrl;
+	char			attdec, susrel;
+	vsid_u16		adsr, freq, pwm;
+	char			tick, delay, pos;
+	SIDFXState		state;
+	char			loop;		// passes left of the finite loop being played
+	bool			jumped;		// a loop went back in this tick
+	bool			regate;		// the gate went off and on again in this tick
+
+	// accurate envelope, counters as in the chip
+	char			env, expcnt;
+	vsid_u16		ratecnt;
+};
+
+// Use the accurate envelope engine instead of the fast approximation
+extern bool	vsid_accurate;
+
+// Envelope steps per player tick
+static const char VSID_SUBSTEPS = 4;
+
+// Maximum value for ADSR emulation
+static const unsigned AMAX	= 32 * 256 - 1;
+
+// Cycles between envelope steps for each rate nibble
+static const unsigned RatePeriod[16] = {
+	9, 32, 63, 95, 149, 220, 267, 313, 392, 977, 1954, 3126, 3907, 11720, 19532, 31251
+};
+
+// Fast engine divisors, attack and decay times in ms
+static const unsigned AttackDiv[16] = {
+	2, 8, 16, 24, 38, 56, 68, 80, 100, 250, 500, 800, 1000, 3000, 5000, 8000
+};
+
+static const unsigned DecayDiv[16] = {
+	6, 24, 48, 72, 114, 168, 204, 240, 300, 750, 1500, 2400, 3000, 9000, 15000, 24000
+};
+
+#ifdef __OSCAR64C__
+
+static const char Count2Level[256] = {
+	#for (i, 256) exp(i / 54.0) / exp(255.0 / 54.0) * 31.0,
+};
+
+static const char Sustain2Count[16] = {
+	#for (i, 16) log(i * exp(255.0 / 54.0) / 15.0) * 54.0,
+};
+
+#else
+
+// built by vsid_init
+extern char		Count2Level[256], Sustain2Count[16];
+
+#endif
+
+// Per envelope step increments of the fast engine, and steps and leftover
+// cycles of each rate for the accurate one, set up by vsid_init for the
+// tick rate
+extern unsigned	AttackStep[16], DecayStep[16];
+extern unsigned	EBATCH, EnvHits[16], EnvRem[16];
+
+// Tick length in 8.8 fixed point ms and in cycles, can be called again
+// when the tick rate changes
+inline void vsid_init(unsigned tstep, unsigned tcycles)
+{
+	unsigned astep = (unsigned long)AMAX * tstep / (4 * 256);
+
+	EBATCH = tcycles / VSID_SUBSTEPS;
+	for(char i=0; i<16; i++)
+	{
+		AttackStep[i] = astep / AttackDiv[i];
+		DecayStep[i] = astep / DecayDiv[i];
+		EnvHits[i] = EBATCH / RatePeriod[i];
+		EnvRem[i] = EBATCH - EnvHits[i] * RatePeriod[i];
+	}
+
+#ifndef __OSCAR64C__
+	// the host has no #for to build these at compile time
+	for(int i=0; i<16; i++)
+		Sustain2Count[i] = i ? (char)(log(i * exp(255.0 / 54.0) / 15.0) * 54.0) : 0;
+	for(int i=0; i<256; i++)
+		Count2Level[i] = (char)(exp(i / 54.0) / exp(255.0 / 54.0) * 31.0);
+#endif
+}
+
+inline void vsid_reset(VirtualSID & v)
+{
+	v.phase = PHASE_OFF;
+	v.env = 0;
+	v.expcnt = 0;
+	v.ratecnt = 0;
+	v.ctrl = 0;
+	v.state = SIDFX_READY;
+	v.delay = 1;
+	v.tick = 0;
+	v.pos = 0;
+	v.loop = 0;
+	v.jumped = false;
+	v.regate = false;
+}
+
+// A row with only the test bit in ctrl is a loop row: it plays the rows
+// from row freq up to it time1 times in all, or forever when time1 is 0.
+// Loop rows take no time, a finite loop must not hold another finite loop
+// and a loop that would go back twice in one tick ends the effect.
+inline bool vsid_isloop(const SIDFX & s)
+{
+	return s.ctrl == SID_CTRL_TEST;
+}
+
+// Row that follows v.pos, n at the end
+inline char vsid_next(VirtualSID & v, const SIDFX * fx, char n)
+{
+	char pos = v.pos + 1;
+	while (pos < n && vsid_isloop(fx[pos]))
+	{
+		const SIDFX	&	l = fx[pos];
+		if (l.time1)
+		{
+			if (!v.loop)
+				v.loop = l.time1;
+			v.loop--;
+		}
+
+		if (!l.time1 || v.loop)
+		{
+			if (v.jumped || l.freq >= n)
+				return n;
+			v.jumped = true;
+			pos = l.freq;
+		}
+		else
+			pos++;
+	}
+	return pos;
+}
+
+// Envelope level 0 to 31 as drawn in the preview, linear while attacking
+inline char vsid_level(const VirtualSID & v)
+{
+	if (vsid_accurate)
+		return v.env >> 3;
+	else if (v.phase == PHASE_ATTACK)
+		return v.adsr >> 8;
+	else
+		return Count2Level[v.adsr >> 5];
+}
+
+// Envelope steps between the exponential decay steps at a level
+inline char vsid_exp_period(char env)
+{
+	if (env >= 93) return 1;
+	if (env >= 54) return 2;
+	if (env >= 26) return 4;
+	if (env >= 14) return 8;
+	if (env >= 6) return 16;
+	return 30;
+}
+
+// Accurate engine, runs the 15 bit rate counter for EBATCH cycles with the
+// per rate tables and applies the resulting envelope steps
+inline void vsid_envelope(VirtualSID & v)
+{
+	char	r;
+	switch (v.phase)
+	{
+	case PHASE_ATTACK:
+		r = v.attdec >> 4;
+		break;
+	case PHASE_DECAY:
+		r = v.attdec & 0x0f;
+		break;
+	default:
+		r = v.susrel & 0x0f;
+		break;
+	}
+
+	unsigned	period = RatePeriod[r];
+	unsigned	hits;
+
+	if (v.ratecnt < period)
+	{
+		hits = EnvHits[r];
+		v.ratecnt += EnvRem[r];
+		if (v.ratecnt >= period)
+		{
+			v.ratecnt -= period;
+			hits++;
+		}
+	}
+	else
+	{
+		// ADSR delay bug, the rate got shorter than the counter already
+		// is, so it has to wrap around at 0x8000 before the next step
+		unsigned	left = 0x8000 - v.ratecnt;
+		if (EBATCH < left)
+		{
+			v.ratecnt += EBATCH;
+			return;
+		}
+		unsigned	rest = EBATCH - left;
+		hits = rest / period;
+		v.ratecnt = rest - hits * period;
+	}
+
+	if (!hits)
+		return;
+
+	if (v.phase == PHASE_ATTACK)
+	{
+		char	room = 0xff - v.env;
+		if (hits >= room)
+		{
+			v.env = 0xff;
+			v.phase = PHASE_DECAY;
+		}
+		else
+			v.env += hits;
+		v.expcnt = 0;
+	}
+	else
+	{
+		// decay stops when the level equals sustain, release at zero
+		char	stop = v.phase == PHASE_DECAY ? (v.susrel >> 4) * 0x11 : 0;
+		while (hits && v.env != stop && v.env)
+		{
+			char	need = vsid_exp_period(v.env) - v.expcnt;
+			if (hits < need)
+			{
+				v.expcnt += hits;
+				return;
+			}
+			hits -= need;
+			v.expcnt = 0;
+			v.env--;
+		}
+		if (!v.env && v.phase == PHASE_RELEASE)
+			v.phase = PHASE_OFF;
+	}
+}
+
+// One envelope step, VSID_SUBSTEPS of these make a player tick
+inline void vsid_advance(VirtualSID & v)
+{
+	if (v.ctrl & SID_CTRL_GATE)
+	{
+		if (v.phase < PHASE_ATTACK)
+		{
+			v.phase = PHASE_ATTACK;
+			v.adsr = 0;
+		}
+	}
+	else
+	{
+		if (v.phase >= PHASE_ATTACK)
+			v.phase = PHASE_RELEASE;
+	}
+
+	if (vsid_accurate)
+	{
+		vsid_envelope(v);
+		return;
+	}
+
+	switch (v.phase)
+	{
+	case PHASE_ATTACK:
+		// Increase channel power during attack phase
+		v.adsr += AttackStep[v.attdec >> 4];
+		if (v.adsr >= AMAX)
+		{
+			// Switch to decay phase next
+			v.adsr = AMAX;
+			v.phase = PHASE_DECAY;
+		}
+		break;
+	case PHASE_DECAY:
+		{
+			// Decrease channel power during decay phase
+			unsigned sus = Sustain2Count[v.susrel >> 4] << 5;
+			unsigned dec = DecayStep[v.attdec & 0x0f];
+
+			if (v.adsr > sus + dec)
+				v.adsr -= dec;
+			else if (v.adsr > sus)
+				v.adsr = sus;
+		}
+		break;
+	case PHASE_RELEASE:
+		{
+			// Decrease channel power during release phase
+			unsigned dec = DecayStep[v.susrel & 0x0f];
+
+			if (v.adsr > dec)
+				v.adsr -= dec;
+			else
+			{
+				// Switch to off when energy reaches flat
+				v.adsr = 0;
+				v.phase = PHASE_OFF;
+			}
+		}
+		break;
+	default:
+		break;
+	}
+}
+
+// One player tick of the sidfx state machine over the effect list fx with
+// n rows, the envelope is not advanced
+inline void vsid_tick(VirtualSID & v, const SIDFX * fx, char n)
+{
+	const SIDFX	*	com = fx + v.pos;
+	v.jumped = false;
+	v.regate = false;
+	v.delay--;
+	if (v.delay)
+	{
+		if (com->dfreq)
+			v.freq += com->dfreq;
+		if (com->dpwm)
+			v.pwm += com->dpwm;
+	}
+	while (!v.delay)
+	{
+		switch (v.state)
+		{
+		case SIDFX_IDLE:
+			v.delay = 1;
+			break;
+		case SIDFX_RESET_0:
+			v.ctrl = 0;
+			v.attdec = 0;
+			v.susrel = 0;
+			v.state = SIDFX_READY;
+			v.delay = 1;
+			break;
+		case SIDFX_READY:
+			if (v.pos < n)
+			{
+				v.freq = com->freq;
+				v.pwm = com->pwm;
+				v.attdec = com->attdec;
+				v.susrel = com->susrel;
+				v.ctrl = com->ctrl;
+
+				if (com->ctrl & SID_CTRL_GATE)
+				{
+					v.delay = com->time1;
+					v.state = SIDFX_PLAY;
+				}
+				else
+				{
+					v.delay = com->time0;
+					v.state = SIDFX_WAIT;
+				}
+			}
+			else
+				v.state = SIDFX_IDLE;
+			break;
+		case SIDFX_PLAY:
+			if (com->time0)
+			{
+				v.ctrl = com->ctrl & ~SID_CTRL_GATE;
+				v.delay = com->time0 - 1;
+				v.state = SIDFX_WAIT;
+			}
+			else
+			{
+				v.pos = vsid_next(v, fx, n);
+				if (v.pos < n)
+				{
+					char sr = com->susrel & 0xf0;
+					com = fx + v.pos;
+					if ((com->attdec & 0xef) == 0 && (com->ctrl & SID_CTRL_GATE) && (com->susrel & 0xf0) > sr)
+					{
+						v.phase = PHASE_RELEASE;
+						v.regate = true;
+					}
+					v.state = SIDFX_READY;
+				}
+				else
+					v.state = SIDFX_RESET_0;
+			}
+			break;
+		case SIDFX_WAIT:
+			v.pos = vsid_next(v, fx, n);
+			if (v.pos < n)
+			{
+				com = fx + v.pos;
+				if (com->ctrl & SID_CTRL_GATE)
+					v.state = SIDFX_RESET_0;
+				else
+					v.state = SIDFX_READY;
+			}
+			else
+				v.state = SIDFX_RESET_0;
+			break;
+		}
+	}
+}
+
+#ifdef __OSCAR64C__
+#pragma compile("vsid.cpp")
+#endif
+
+#endif